@@ -18,6 +18,7 @@
 #define KEYLEDS_RENDER_TARGET_H_7E2781C6
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <utility>
 #include "keyledsd/accelerated.h"
@@ -79,6 +80,19 @@ private:
 void swap(RenderTarget &, RenderTarget &) noexcept;
 void blend(RenderTarget &, const RenderTarget &) noexcept;
 void multiply(RenderTarget &, const RenderTarget &) noexcept;
+void add(RenderTarget &, const RenderTarget &) noexcept;
+void screen(RenderTarget &, const RenderTarget &) noexcept;
+void lighten(RenderTarget &, const RenderTarget &) noexcept;
+void darken(RenderTarget &, const RenderTarget &) noexcept;
+void fade(RenderTarget &, uint8_t alpha) noexcept;
+void lerp(RenderTarget &, const RenderTarget &, uint8_t t) noexcept;
+void copy_masked(RenderTarget &, const RenderTarget &, const RenderTarget & mask) noexcept;
+/// Sets the color of listed keys only. Indices must be within target size.
+KEYLEDSD_EXPORT void fill_indexed(RenderTarget &, const unsigned * indices, std::size_t count,
+                                  RGBAColor) noexcept;
+/// Blends listed keys only, with the same arithmetic as blend.
+KEYLEDSD_EXPORT void blend_indexed(RenderTarget &, const RenderTarget &,
+                                   const unsigned * indices, std::size_t count) noexcept;
 
 /****************************************************************************/
 
@@ -94,6 +108,17 @@ protected:
 public:
     /// Modifies the target to reflect effect's display once the specified time has elapsed
     virtual void    render(unsigned long nanosec, RenderTarget & target) = 0;
+
+    /// Layer-independent renderers draw into a layer of their own, without reading
+    /// the target, then blend that layer onto it. Those can instead update their layer
+    /// exactly as render would and return it, leaving the blending to the caller. This
+    /// method may then be invoked concurrently with other renderers. Other renderers
+    /// must return nullptr, which is the default.
+    virtual const RenderTarget * renderLayer(unsigned long) { return nullptr; }
+
+    /// Invoked on the render thread once the frame is sent to the device, for
+    /// housekeeping that should not delay the frame. Default does nothing.
+    virtual void    frameDone() {}
 protected:
     // Protect the destructor so we can leave it non-virtual
     ~Renderer() {}
@@ -123,6 +148,56 @@ inline void multiply(RenderTarget & lhs, const RenderTarget & rhs) noexcept
              reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
 }
 
+inline void add(RenderTarget & lhs, const RenderTarget & rhs) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    add(reinterpret_cast<uint8_t*>(lhs.data()),
+        reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+}
+
+inline void screen(RenderTarget & lhs, const RenderTarget & rhs) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    screen(reinterpret_cast<uint8_t*>(lhs.data()),
+           reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+}
+
+inline void lighten(RenderTarget & lhs, const RenderTarget & rhs) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    lighten(reinterpret_cast<uint8_t*>(lhs.data()),
+            reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+}
+
+inline void darken(RenderTarget & lhs, const RenderTarget & rhs) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    darken(reinterpret_cast<uint8_t*>(lhs.data()),
+           reinterpret_cast<const uint8_t*>(rhs.data()), rhs.capacity());
+}
+
+inline void fade(RenderTarget & lhs, uint8_t alpha) noexcept
+{
+    fade(reinterpret_cast<uint8_t*>(lhs.data()), alpha, lhs.capacity());
+}
+
+inline void lerp(RenderTarget & lhs, const RenderTarget & rhs, uint8_t t) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    lerp(reinterpret_cast<uint8_t*>(lhs.data()),
+         reinterpret_cast<const uint8_t*>(rhs.data()), t, rhs.capacity());
+}
+
+inline void copy_masked(RenderTarget & lhs, const RenderTarget & rhs,
+                        const RenderTarget & mask) noexcept
+{
+    assert(lhs.capacity() == rhs.capacity());
+    assert(lhs.capacity() == mask.capacity());
+    copy_masked(reinterpret_cast<uint8_t*>(lhs.data()),
+                reinterpret_cast<const uint8_t*>(rhs.data()),
+                reinterpret_cast<const uint8_t*>(mask.data()), rhs.capacity());
+}
+
 } // keyleds
 
 #endif
@@ -22,6 +22,15 @@ namespace keyleds {
 extern "C" {
 #endif
 
+/* Every function in this file has a variant per instruction set: AVX-512BW,
+ * AVX2, SSE2, NEON and plain C. Each is bound once to the fastest variant the
+ * build includes and the running CPU supports, when the library is loaded if
+ * the toolchain supports ifuncs, on first call otherwise. All variants give
+ * the same results, except for values documented as undefined.
+ * Alignment and length requirements are those of the widest variant;
+ * RenderTarget buffers always satisfy them.
+ */
+
 /** Blend two R8G8B8A8 color streams
  *
  * Perform a regular alpha blending, that is, compute:
@@ -32,30 +41,125 @@ extern "C" {
  * \end{align*}
  * The value of a's alpha channel after the blending is undefined.
  *
- * The blending operation uses SSE2 or MMX if available.
- *
- * @param[in|out] a An array of colors used as a destination. Must be 16-byte aligned.
- * @param b An array of colors used as a source. Must be 16-byte aligned.
- * @param length The number of colors in the arrays. Must be a multiple of 4.
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
  * @note Arrays must not overlap.
  */
 void blend(uint8_t * a, const uint8_t * b, unsigned length);
 
 /** Multiply two R8G8B8A8 color streams
  *
- * Performs a simple multiplication.
+ * Performs a simple multiplication, on all four channels.
  * \f$\begin{align*}
+ *      a_n^{c}&=a_n^{c}b_n^{c}
  * \end{align*}
  *
- * The product operation uses SSE2 or MMX if available.
- *
- * @param[in|out] a An array of colors used as a destination. Must be 16-byte aligned.
- * @param b An array of colors used as a source. Must be 16-byte aligned.
- * @param length The number of colors in the arrays. Must be a multiple of 4.
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
  * @note Arrays must not overlap.
  */
 void multiply(uint8_t * a, const uint8_t * b, unsigned length);
 
+/** Add two R8G8B8A8 color streams
+ *
+ * Performs additive blending, weighting b by its alpha channel and saturating
+ * the result.
+ * \f$\begin{align*}
+ *      a_n^{r}&=\min(1, a_n^{r}+b_n^{r}b_n^\alpha) \\
+ *      a_n^{g}&=\min(1, a_n^{g}+b_n^{g}b_n^\alpha) \\
+ *      a_n^{b}&=\min(1, a_n^{b}+b_n^{b}b_n^\alpha) \\
+ * \end{align*}
+ * The value of a's alpha channel after the operation is undefined.
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Arrays must not overlap.
+ */
+void add(uint8_t * a, const uint8_t * b, unsigned length);
+
+/** Screen two R8G8B8A8 color streams
+ *
+ * Performs the inverse of multiply, on all four channels. Result is always
+ * at least as bright as either input.
+ * \f$\begin{align*}
+ *      a_n^{c}&=1-(1-a_n^{c})(1-b_n^{c})
+ * \end{align*}
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Arrays must not overlap.
+ */
+void screen(uint8_t * a, const uint8_t * b, unsigned length);
+
+/** Lighten a R8G8B8A8 color stream with another
+ *
+ * Keeps the maximum of both streams, independently on all four channels.
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Arrays must not overlap.
+ */
+void lighten(uint8_t * a, const uint8_t * b, unsigned length);
+
+/** Darken a R8G8B8A8 color stream with another
+ *
+ * Keeps the minimum of both streams, independently on all four channels.
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Arrays must not overlap.
+ */
+void darken(uint8_t * a, const uint8_t * b, unsigned length);
+
+/** Fade a R8G8B8A8 color stream by a constant alpha
+ *
+ * Multiplies the alpha channel of all colors by a constant, leaving other
+ * channels untouched. Useful to fade a whole layer before blending it.
+ * \f$\begin{align*}
+ *      a_n^{\alpha}&=a_n^{\alpha}\alpha
+ * \end{align*}
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param alpha Constant alpha, 0 meaning transparent and 255 meaning unchanged.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ */
+void fade(uint8_t * a, uint8_t alpha, unsigned length);
+
+/** Linearly interpolate between two R8G8B8A8 color streams
+ *
+ * Similar to blend, but uses a constant weight instead of b's alpha channel,
+ * and interpolates all four channels.
+ * \f$\begin{align*}
+ *      a_n^{c}&=a_n^{c}(1-t)+b_n^{c}t
+ * \end{align*}
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param t Interpolation weight, 0 yielding a and 255 yielding b.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Arrays must not overlap.
+ */
+void lerp(uint8_t * a, const uint8_t * b, uint8_t t, unsigned length);
+
+/** Copy a R8G8B8A8 color stream through a mask
+ *
+ * Copies colors of b into a, for all entries whose alpha channel is not zero
+ * in mask. Other entries of a are left untouched.
+ *
+ * @param[in|out] a An array of colors used as a destination. Must be 64-byte aligned.
+ * @param b An array of colors used as a source. Must be 64-byte aligned.
+ * @param mask An array of colors used as a mask. Must be 64-byte aligned.
+ * @param length The number of colors in the arrays. Must be a multiple of 16.
+ * @note Destination must not overlap with other arrays.
+ */
+void copy_masked(uint8_t * a, const uint8_t * b, const uint8_t * mask, unsigned length);
+
 #ifdef __cplusplus
 }
 } // namespace keyleds
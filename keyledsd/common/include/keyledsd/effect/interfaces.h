@@ -17,6 +17,7 @@
 #ifndef KEYLEDSD_EFFECT_INTERFACES_H_07881F1A
 #define KEYLEDSD_EFFECT_INTERFACES_H_07881F1A
 
+#include <functional>
 #include <string>
 #include <vector>
 #include "keyledsd/KeyDatabase.h"
@@ -32,6 +33,7 @@ class EffectService;
 // IMPLEMENTED BY PLUGIN
 
 /// Core object used by DeviceManager and RenderLoop
+/// Once the effect is active, all its methods are invoked from the render thread.
 class Effect
 {
 protected:
@@ -92,6 +94,9 @@ public:
     virtual void                destroyRenderTarget(RenderTarget *) = 0;
 
     virtual const std::string & getFile(const std::string &) = 0;
+    /// Invokes listener from main thread whenever file, as found by getFile, is modified.
+    /// Watches end when the effect is destroyed.
+    virtual void                watchFile(const std::string &, std::function<void()>) = 0;
 
     virtual void                log(unsigned, const char *) = 0;
 };
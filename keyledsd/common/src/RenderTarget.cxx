@@ -16,14 +16,16 @@
  */
 #include "keyledsd/RenderTarget.h"
 
+#include <cassert>
 #include <cstddef>
 #include <type_traits>
 #include <utility>
+#include "accelerated_plain.h"
 
 static_assert(std::is_pod<keyleds::RGBAColor>::value, "RGBAColor must be a POD type");
 static_assert(sizeof(keyleds::RGBAColor) == 4, "RGBAColor must be tightly packed");
 
-static constexpr std::size_t alignBytes = 32;  // 16 is minimum for SSE2, 32 for AVX2
+static constexpr std::size_t alignBytes = 64;  // 16 is minimum for SSE2, 32 for AVX2, 64 for AVX-512
 static constexpr std::size_t alignColors = alignBytes / sizeof(keyleds::RGBAColor);
 
 using keyleds::RenderTarget;
@@ -63,3 +65,24 @@ RenderTarget::~RenderTarget()
 {
     free(m_colors);
 }
+
+/****************************************************************************/
+
+void keyleds::fill_indexed(RenderTarget & target, const unsigned * indices, std::size_t count,
+                           RGBAColor color) noexcept
+{
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        assert(indices[idx] < target.size());
+        target[indices[idx]] = color;
+    }
+}
+
+void keyleds::blend_indexed(RenderTarget & lhs, const RenderTarget & rhs,
+                            const unsigned * indices, std::size_t count) noexcept
+{
+    for (std::size_t idx = 0; idx < count; ++idx) {
+        assert(indices[idx] < lhs.size() && indices[idx] < rhs.size());
+        blend_color_plain(reinterpret_cast<uint8_t *>(&lhs[indices[idx]]),
+                          reinterpret_cast<const uint8_t *>(&rhs[indices[idx]]));
+    }
+}
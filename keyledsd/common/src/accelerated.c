@@ -17,79 +17,134 @@
 #include <stdint.h>
 #include "keyledsd/accelerated.h"
 #include "config.h"
+#ifdef HAVE_GETAUXVAL
+#  include <sys/auxv.h>
+#endif
 
 /****************************************************************************/
-/* blend */
-
-void blend_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void blend_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void blend_plain(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
+/* Dispatch machinery
+ *
+ * Every operation is implemented once per instruction set, in its own source
+ * file compiled with matching flags. The public symbol is then bound to the
+ * best implementation for current CPU, once, using a gnu ifunc if available
+ * or a lazily-resolved function pointer otherwise.
+ *
+ * On x86, the CPU is queried with __builtin_cpu_supports. On ARM, where it is
+ * not available, kernel-provided hardware capabilities are used instead.
+ */
 
-#ifdef HAVE_BUILTIN_CPU_SUPPORTS
-static void (*resolve_blend(void))(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-{
-#  if defined __GNUC__ && !defined __clang__
-    __builtin_cpu_init();
-#  endif
-#  ifdef KEYLEDSD_USE_AVX2
-    if (__builtin_cpu_supports("avx2")) { return blend_avx2; }
-#  endif
-#  ifdef KEYLEDSD_USE_SSE2
-    if (__builtin_cpu_supports("sse2")) { return blend_sse2; }
+#ifdef KEYLEDSD_USE_AVX512
+#  define RESOLVE_AVX512(name) if (__builtin_cpu_supports("avx512bw")) { return name##_avx512; }
+#else
+#  define RESOLVE_AVX512(name)
+#endif
+#ifdef KEYLEDSD_USE_AVX2
+#  define RESOLVE_AVX2(name) if (__builtin_cpu_supports("avx2")) { return name##_avx2; }
+#else
+#  define RESOLVE_AVX2(name)
+#endif
+#ifdef KEYLEDSD_USE_SSE2
+#  define RESOLVE_SSE2(name) if (__builtin_cpu_supports("sse2")) { return name##_sse2; }
+#else
+#  define RESOLVE_SSE2(name)
+#endif
+#ifdef KEYLEDSD_USE_NEON
+#  if defined __aarch64__
+#    define RESOLVE_NEON(name) if (getauxval(AT_HWCAP) & HWCAP_ASIMD) { return name##_neon; }
+#  else
+#    define RESOLVE_NEON(name) if (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) { return name##_neon; }
 #  endif
-    return blend_plain;
-}
+#else
+#  define RESOLVE_NEON(name)
+#endif
+#if defined HAVE_BUILTIN_CPU_SUPPORTS && defined __GNUC__ && !defined __clang__
+#  define RESOLVE_INIT() __builtin_cpu_init()
+#else
+#  define RESOLVE_INIT()
+#endif
 
+#if defined HAVE_BUILTIN_CPU_SUPPORTS || (defined KEYLEDSD_USE_NEON && defined HAVE_GETAUXVAL)
+#  define DEFINE_RESOLVER(name, params) \
+    static void (*resolve_##name(void)) params \
+    { \
+        RESOLVE_INIT(); \
+        RESOLVE_AVX512(name) \
+        RESOLVE_AVX2(name) \
+        RESOLVE_SSE2(name) \
+        RESOLVE_NEON(name) \
+        return name##_plain; \
+    }
 #  ifdef HAVE_IFUNC_ATTRIBUTE
-void blend(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-    __attribute__((ifunc("resolve_blend")));
+#    define DEFINE_ACCELERATED(name, params, args) \
+    DEFINE_RESOLVER(name, params) \
+    void name params __attribute__((ifunc("resolve_" #name)));
 #  else
-static void (*resolved_blend)(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void blend(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-{
-    if (resolved_blend == 0) { resolved_blend = resolve_blend(); }
-    (*resolved_blend)(dst, src, length);
-}
+#    define DEFINE_ACCELERATED(name, params, args) \
+    DEFINE_RESOLVER(name, params) \
+    static void (*resolved_##name) params; \
+    void name params \
+    { \
+        if (resolved_##name == 0) { resolved_##name = resolve_##name(); } \
+        (*resolved_##name) args; \
+    }
 #  endif
 #else
-void blend(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-    { blend_plain(dst, src, length); }
+#  define DEFINE_ACCELERATED(name, params, args) \
+    void name params { name##_plain args; }
 #endif
 
+#define DECLARE_VARIANTS(name, params) \
+    void name##_avx512 params; \
+    void name##_avx2 params; \
+    void name##_sse2 params; \
+    void name##_neon params; \
+    void name##_plain params;
+
 /****************************************************************************/
-/* multiply */
+/* Two-stream operations */
 
-void multiply_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void multiply_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void multiply_plain(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
+#define STREAM_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+#define STREAM_ARGS (dst, src, length)
 
-#ifdef HAVE_BUILTIN_CPU_SUPPORTS
-static void (*resolve_multiply(void))(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-{
-#  if defined __GNUC__ && !defined __clang__
-    __builtin_cpu_init();
-#  endif
-#  ifdef KEYLEDSD_USE_AVX2
-    if (__builtin_cpu_supports("avx2")) { return multiply_avx2; }
-#  endif
-#  ifdef KEYLEDSD_USE_SSE2
-    if (__builtin_cpu_supports("sse2")) { return multiply_sse2; }
-#  endif
-    return multiply_plain;
-}
+DECLARE_VARIANTS(blend, STREAM_PARAMS)
+DEFINE_ACCELERATED(blend, STREAM_PARAMS, STREAM_ARGS)
 
-#  ifdef HAVE_IFUNC_ATTRIBUTE
-void multiply(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-    __attribute__((ifunc("resolve_multiply")));
-#  else
-static void (*resolved_multiply)(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length);
-void multiply(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-{
-    if (resolved_multiply == 0) { resolved_multiply = resolve_multiply(); }
-    (*resolved_multiply)(dst, src, length);
-}
-#  endif
-#else
-void multiply(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
-    { multiply_plain(dst, src, length); }
-#endif
+DECLARE_VARIANTS(multiply, STREAM_PARAMS)
+DEFINE_ACCELERATED(multiply, STREAM_PARAMS, STREAM_ARGS)
+
+DECLARE_VARIANTS(add, STREAM_PARAMS)
+DEFINE_ACCELERATED(add, STREAM_PARAMS, STREAM_ARGS)
+
+DECLARE_VARIANTS(screen, STREAM_PARAMS)
+DEFINE_ACCELERATED(screen, STREAM_PARAMS, STREAM_ARGS)
+
+DECLARE_VARIANTS(lighten, STREAM_PARAMS)
+DEFINE_ACCELERATED(lighten, STREAM_PARAMS, STREAM_ARGS)
+
+DECLARE_VARIANTS(darken, STREAM_PARAMS)
+DEFINE_ACCELERATED(darken, STREAM_PARAMS, STREAM_ARGS)
+
+/****************************************************************************/
+/* Constant-weighted operations */
+
+#define FADE_PARAMS (uint8_t * restrict dst, uint8_t alpha, unsigned length)
+#define FADE_ARGS (dst, alpha, length)
+
+DECLARE_VARIANTS(fade, FADE_PARAMS)
+DEFINE_ACCELERATED(fade, FADE_PARAMS, FADE_ARGS)
+
+#define LERP_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+#define LERP_ARGS (dst, src, t, length)
+
+DECLARE_VARIANTS(lerp, LERP_PARAMS)
+DEFINE_ACCELERATED(lerp, LERP_PARAMS, LERP_ARGS)
+
+/****************************************************************************/
+/* Masked operations */
+
+#define MASKED_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, \
+                       const uint8_t * restrict mask, unsigned length)
+#define MASKED_ARGS (dst, src, mask, length)
+
+DECLARE_VARIANTS(copy_masked, MASKED_PARAMS)
+DEFINE_ACCELERATED(copy_masked, MASKED_PARAMS, MASKED_ARGS)
@@ -92,8 +92,8 @@ void multiply_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigne
         __m256i src0 = _mm256_unpacklo_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
         __m256i src1 = _mm256_unpackhi_epi8(packed_src, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
 
-        dst0 = _mm256_mullo_epi16(src0, _mm256_add_epi16(dst0, one));
-        dst1 = _mm256_mullo_epi16(src1, _mm256_add_epi16(dst1, one));
+        dst0 = _mm256_mullo_epi16(dst0, _mm256_add_epi16(src0, one));
+        dst1 = _mm256_mullo_epi16(dst1, _mm256_add_epi16(src1, one));
 
         dst0 = _mm256_srli_epi16(dst0, 8);
         dst1 = _mm256_srli_epi16(dst1, 8);
@@ -103,3 +103,230 @@ void multiply_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigne
         dstv += 1;
     } while (--length > 0);
 }
+
+void add_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_load_si256(dstv);
+        __m256i packed_src = _mm256_load_si256(srcv);
+
+        __m256i dst0 = _mm256_unpacklo_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i dst1 = _mm256_unpackhi_epi8(packed_dst, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+        __m256i src0 = _mm256_unpacklo_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i src1 = _mm256_unpackhi_epi8(packed_src, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        __m256i alpha0 = _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = _mm256_add_epi16(alpha0, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha0, zero), one));
+        __m256i alpha1 = _mm256_shufflelo_epi16(_mm256_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = _mm256_add_epi16(alpha1, _mm256_add_epi16(_mm256_cmpeq_epi16(alpha1, zero), one));
+
+        __m256i weighted_src0 = _mm256_srli_epi16(_mm256_mullo_epi16(src0, alpha0), 8);
+        __m256i weighted_src1 = _mm256_srli_epi16(_mm256_mullo_epi16(src1, alpha1), 8);
+
+        /* packus saturates the sum to 255 */
+        _mm256_store_si256(dstv, _mm256_packus_epi16(_mm256_add_epi16(dst0, weighted_src0),
+                                                     _mm256_add_epi16(dst1, weighted_src1)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void screen_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_load_si256(dstv);
+        __m256i packed_src = _mm256_load_si256(srcv);
+
+        __m256i dst0 = _mm256_unpacklo_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i dst1 = _mm256_unpackhi_epi8(packed_dst, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+        __m256i src0 = _mm256_unpacklo_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i src1 = _mm256_unpackhi_epi8(packed_src, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        __m256i product0 = _mm256_srli_epi16(_mm256_mullo_epi16(dst0, _mm256_add_epi16(src0, one)), 8);
+        __m256i product1 = _mm256_srli_epi16(_mm256_mullo_epi16(dst1, _mm256_add_epi16(src1, one)), 8);
+
+        dst0 = _mm256_sub_epi16(_mm256_add_epi16(dst0, src0), product0);
+        dst1 = _mm256_sub_epi16(_mm256_add_epi16(dst1, src1), product1);
+
+        _mm256_store_si256(dstv, _mm256_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lighten_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    length /= 8;
+
+    do {
+        _mm256_store_si256(dstv, _mm256_max_epu8(_mm256_load_si256(dstv), _mm256_load_si256(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void darken_avx2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    length /= 8;
+
+    do {
+        _mm256_store_si256(dstv, _mm256_min_epu8(_mm256_load_si256(dstv), _mm256_load_si256(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void fade_avx2(uint8_t * restrict dst, uint8_t alpha, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const short factor = (short)alpha + 1;
+    /* Color channels are multiplied by 256, alpha channel by factor */
+    const __m256i factors = _mm256_set_epi16(factor, 256, 256, 256, factor, 256, 256, 256,
+                                             factor, 256, 256, 256, factor, 256, 256, 256);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_load_si256(dstv);
+
+        __m256i dst0 = _mm256_unpacklo_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i dst1 = _mm256_unpackhi_epi8(packed_dst, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        dst0 = _mm256_srli_epi16(_mm256_mullo_epi16(dst0, factors), 8);
+        dst1 = _mm256_srli_epi16(_mm256_mullo_epi16(dst1, factors), 8);
+
+        _mm256_store_si256(dstv, _mm256_packus_epi16(dst0, dst1));
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lerp_avx2(uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const short weight = t != 0 ? (short)t + 1 : 0;
+    const __m256i src_weight = _mm256_set1_epi16(weight);
+    const __m256i dst_weight = _mm256_set1_epi16(256 - weight);
+
+    length /= 8;
+
+    do {
+        __m256i packed_dst = _mm256_load_si256(dstv);
+        __m256i packed_src = _mm256_load_si256(srcv);
+
+        __m256i dst0 = _mm256_unpacklo_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i dst1 = _mm256_unpackhi_epi8(packed_dst, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+        __m256i src0 = _mm256_unpacklo_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2A1B1G1R1A0B0G0R0 */
+        __m256i src1 = _mm256_unpackhi_epi8(packed_src, zero); /* A7B7G7R7A6B6G6R6A5B5G5R5A4B4G4R4 */
+
+        dst0 = _mm256_add_epi16(_mm256_mullo_epi16(dst0, dst_weight), _mm256_mullo_epi16(src0, src_weight));
+        dst1 = _mm256_add_epi16(_mm256_mullo_epi16(dst1, dst_weight), _mm256_mullo_epi16(src1, src_weight));
+
+        dst0 = _mm256_srli_epi16(dst0, 8);
+        dst1 = _mm256_srli_epi16(dst1, 8);
+
+        _mm256_store_si256(dstv, _mm256_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void copy_masked_avx2(uint8_t * restrict dst, const uint8_t * restrict src,
+                      const uint8_t * restrict mask, unsigned length)
+{
+    assert((uintptr_t)dst % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)src % 32 == 0);   // AVX2 requires 32-bytes aligned data
+    assert((uintptr_t)mask % 32 == 0);  // AVX2 requires 32-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    __m256i * restrict dstv = (__m256i *)__builtin_assume_aligned(dst, 32);
+    const __m256i * restrict srcv = (const __m256i *)__builtin_assume_aligned(src, 32);
+    const __m256i * restrict maskv = (const __m256i *)__builtin_assume_aligned(mask, 32);
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i alpha_bits = _mm256_set1_epi32((int)0xff000000);
+
+    length /= 8;
+
+    do {
+        /* keep is all ones for entries whose mask alpha is zero */
+        __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_load_si256(maskv), alpha_bits),
+                                          zero);
+
+        _mm256_store_si256(dstv, _mm256_or_si256(_mm256_and_si256(keep, _mm256_load_si256(dstv)),
+                                                 _mm256_andnot_si256(keep, _mm256_load_si256(srcv))));
+        maskv += 1;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
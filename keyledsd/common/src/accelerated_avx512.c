@@ -0,0 +1,339 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <immintrin.h>
+#include "config.h"
+
+/* AVX-512BW comparisons yield bit masks rather than vectors. This adds one
+ * to all non-zero alpha values, the same way other variants do.
+ */
+static inline __m512i adjust_alpha(__m512i alpha, __m512i one)
+{
+    return _mm512_mask_add_epi16(alpha, _mm512_test_epi16_mask(alpha, alpha), alpha, one);
+}
+
+void blend_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi16(1);
+    const __m512i max = _mm512_set1_epi16(256);
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+        __m512i packed_src = _mm512_load_si512(srcv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+        __m512i src0 = _mm512_unpacklo_epi8(packed_src, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i src1 = _mm512_unpackhi_epi8(packed_src, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        __m512i alpha0 = _mm512_shufflelo_epi16(_mm512_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = adjust_alpha(alpha0, one);
+        __m512i alpha1 = _mm512_shufflelo_epi16(_mm512_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = adjust_alpha(alpha1, one);
+
+        __m512i weighted_dst0 = _mm512_mullo_epi16(dst0, _mm512_sub_epi16(max, alpha0));
+        __m512i weighted_dst1 = _mm512_mullo_epi16(dst1, _mm512_sub_epi16(max, alpha1));
+        __m512i weighted_src0 = _mm512_mullo_epi16(src0, alpha0);
+        __m512i weighted_src1 = _mm512_mullo_epi16(src1, alpha1);
+
+        __m512i final_dst0 = _mm512_srli_epi16(_mm512_add_epi16(weighted_dst0, weighted_src0), 8);
+        __m512i final_dst1 = _mm512_srli_epi16(_mm512_add_epi16(weighted_dst1, weighted_src1), 8);
+
+        _mm512_store_si512(dstv, _mm512_packus_epi16(final_dst0, final_dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void multiply_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi16(1);
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+        __m512i packed_src = _mm512_load_si512(srcv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+        __m512i src0 = _mm512_unpacklo_epi8(packed_src, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i src1 = _mm512_unpackhi_epi8(packed_src, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        dst0 = _mm512_mullo_epi16(dst0, _mm512_add_epi16(src0, one));
+        dst1 = _mm512_mullo_epi16(dst1, _mm512_add_epi16(src1, one));
+
+        dst0 = _mm512_srli_epi16(dst0, 8);
+        dst1 = _mm512_srli_epi16(dst1, 8);
+
+        _mm512_store_si512(dstv, _mm512_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void add_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi16(1);
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+        __m512i packed_src = _mm512_load_si512(srcv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+        __m512i src0 = _mm512_unpacklo_epi8(packed_src, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i src1 = _mm512_unpackhi_epi8(packed_src, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        __m512i alpha0 = _mm512_shufflelo_epi16(_mm512_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = adjust_alpha(alpha0, one);
+        __m512i alpha1 = _mm512_shufflelo_epi16(_mm512_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = adjust_alpha(alpha1, one);
+
+        __m512i weighted_src0 = _mm512_srli_epi16(_mm512_mullo_epi16(src0, alpha0), 8);
+        __m512i weighted_src1 = _mm512_srli_epi16(_mm512_mullo_epi16(src1, alpha1), 8);
+
+        /* packus saturates the sum to 255 */
+        _mm512_store_si512(dstv, _mm512_packus_epi16(_mm512_add_epi16(dst0, weighted_src0),
+                                                     _mm512_add_epi16(dst1, weighted_src1)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void screen_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i one = _mm512_set1_epi16(1);
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+        __m512i packed_src = _mm512_load_si512(srcv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+        __m512i src0 = _mm512_unpacklo_epi8(packed_src, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i src1 = _mm512_unpackhi_epi8(packed_src, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        __m512i product0 = _mm512_srli_epi16(_mm512_mullo_epi16(dst0, _mm512_add_epi16(src0, one)), 8);
+        __m512i product1 = _mm512_srli_epi16(_mm512_mullo_epi16(dst1, _mm512_add_epi16(src1, one)), 8);
+
+        dst0 = _mm512_sub_epi16(_mm512_add_epi16(dst0, src0), product0);
+        dst1 = _mm512_sub_epi16(_mm512_add_epi16(dst1, src1), product1);
+
+        _mm512_store_si512(dstv, _mm512_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lighten_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    length /= 16;
+
+    do {
+        _mm512_store_si512(dstv, _mm512_max_epu8(_mm512_load_si512(dstv), _mm512_load_si512(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void darken_avx512(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    length /= 16;
+
+    do {
+        _mm512_store_si512(dstv, _mm512_min_epu8(_mm512_load_si512(dstv), _mm512_load_si512(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void fade_avx512(uint8_t * restrict dst, uint8_t alpha, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const uint64_t factor = (uint64_t)alpha + 1;
+    /* Color channels are multiplied by 256, alpha channel by factor */
+    const __m512i factors = _mm512_set1_epi64((long long)(
+        factor << 48 | UINT64_C(256) << 32 | UINT64_C(256) << 16 | UINT64_C(256)
+    ));
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        dst0 = _mm512_srli_epi16(_mm512_mullo_epi16(dst0, factors), 8);
+        dst1 = _mm512_srli_epi16(_mm512_mullo_epi16(dst1, factors), 8);
+
+        _mm512_store_si512(dstv, _mm512_packus_epi16(dst0, dst1));
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lerp_avx512(uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+
+    const __m512i zero = _mm512_setzero_si512();
+    const short weight = t != 0 ? (short)t + 1 : 0;
+    const __m512i src_weight = _mm512_set1_epi16(weight);
+    const __m512i dst_weight = _mm512_set1_epi16(256 - weight);
+
+    length /= 16;
+
+    do {
+        __m512i packed_dst = _mm512_load_si512(dstv);
+        __m512i packed_src = _mm512_load_si512(srcv);
+
+        __m512i dst0 = _mm512_unpacklo_epi8(packed_dst, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i dst1 = _mm512_unpackhi_epi8(packed_dst, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+        __m512i src0 = _mm512_unpacklo_epi8(packed_src, zero); /* 0, 1, 4, 5, 8, 9, 12, 13 */
+        __m512i src1 = _mm512_unpackhi_epi8(packed_src, zero); /* 2, 3, 6, 7, 10, 11, 14, 15 */
+
+        dst0 = _mm512_add_epi16(_mm512_mullo_epi16(dst0, dst_weight),
+                                _mm512_mullo_epi16(src0, src_weight));
+        dst1 = _mm512_add_epi16(_mm512_mullo_epi16(dst1, dst_weight),
+                                _mm512_mullo_epi16(src1, src_weight));
+
+        dst0 = _mm512_srli_epi16(dst0, 8);
+        dst1 = _mm512_srli_epi16(dst1, 8);
+
+        _mm512_store_si512(dstv, _mm512_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void copy_masked_avx512(uint8_t * restrict dst, const uint8_t * restrict src,
+                        const uint8_t * restrict mask, unsigned length)
+{
+    assert((uintptr_t)dst % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)src % 64 == 0);   // AVX-512 requires 64-bytes aligned data
+    assert((uintptr_t)mask % 64 == 0);  // AVX-512 requires 64-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 16 == 0);           // we'll process entries 16 by 16 and don't want to be
+                                        // slowed by boundary checks
+
+    __m512i * restrict dstv = (__m512i *)__builtin_assume_aligned(dst, 64);
+    const __m512i * restrict srcv = (const __m512i *)__builtin_assume_aligned(src, 64);
+    const __m512i * restrict maskv = (const __m512i *)__builtin_assume_aligned(mask, 64);
+
+    const __m512i alpha_bits = _mm512_set1_epi32((int)0xff000000);
+
+    length /= 16;
+
+    do {
+        /* copy is set for entries whose mask alpha is not zero */
+        __mmask16 copy = _mm512_test_epi32_mask(_mm512_load_si512(maskv), alpha_bits);
+
+        _mm512_mask_store_epi32(dstv, copy, _mm512_load_si512(srcv));
+        maskv += 1;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
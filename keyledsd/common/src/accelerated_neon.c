@@ -0,0 +1,289 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <assert.h>
+#include <stdint.h>
+#include <arm_neon.h>
+#include "config.h"
+
+/* Colors are loaded 8 by 8 and deinterleaved, so each vector holds a single
+ * channel. This avoids all the shuffling x86 variants must do to get alpha.
+ */
+
+/// Alpha value to use as a multiplier: adds one to all non-zero values
+static inline uint16x8_t adjust_alpha(uint8x8_t alpha)
+{
+    return vaddw_u8(vmovl_u8(alpha), vshr_n_u8(vtst_u8(alpha, alpha), 7));
+}
+
+/// Computes (a * wa + b * wb) / 256, weights must sum to at most 256
+static inline uint8x8_t mix(uint8x8_t a, uint8x8_t b, uint16x8_t wa, uint16x8_t wb)
+{
+    return vshrn_n_u16(vmlaq_u16(vmulq_u16(vmovl_u8(a), wa), vmovl_u8(b), wb), 8);
+}
+
+void blend_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    const uint16x8_t max = vdupq_n_u16(256);
+
+    length /= 8;
+
+    do {
+        uint8x8x4_t d = vld4_u8(dst);
+        uint8x8x4_t s = vld4_u8(src);
+
+        uint16x8_t alpha = adjust_alpha(s.val[3]);
+        uint16x8_t inverse = vsubq_u16(max, alpha);
+
+        d.val[0] = mix(d.val[0], s.val[0], inverse, alpha);
+        d.val[1] = mix(d.val[1], s.val[1], inverse, alpha);
+        d.val[2] = mix(d.val[2], s.val[2], inverse, alpha);
+
+        vst4_u8(dst, d);
+        src += 32;
+        dst += 32;
+    } while (--length > 0);
+}
+
+void multiply_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    const uint16x8_t one = vdupq_n_u16(1);
+
+    length /= 4;
+
+    do {
+        uint8x16_t d = vld1q_u8(dst);
+        uint8x16_t s = vld1q_u8(src);
+
+        uint16x8_t product0 = vmulq_u16(vmovl_u8(vget_low_u8(d)), vaddw_u8(one, vget_low_u8(s)));
+        uint16x8_t product1 = vmulq_u16(vmovl_u8(vget_high_u8(d)), vaddw_u8(one, vget_high_u8(s)));
+
+        vst1q_u8(dst, vcombine_u8(vshrn_n_u16(product0, 8), vshrn_n_u16(product1, 8)));
+        src += 16;
+        dst += 16;
+    } while (--length > 0);
+}
+
+void add_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    length /= 8;
+
+    do {
+        uint8x8x4_t d = vld4_u8(dst);
+        uint8x8x4_t s = vld4_u8(src);
+
+        uint16x8_t alpha = adjust_alpha(s.val[3]);
+
+        d.val[0] = vqadd_u8(d.val[0], vshrn_n_u16(vmulq_u16(vmovl_u8(s.val[0]), alpha), 8));
+        d.val[1] = vqadd_u8(d.val[1], vshrn_n_u16(vmulq_u16(vmovl_u8(s.val[1]), alpha), 8));
+        d.val[2] = vqadd_u8(d.val[2], vshrn_n_u16(vmulq_u16(vmovl_u8(s.val[2]), alpha), 8));
+
+        vst4_u8(dst, d);
+        src += 32;
+        dst += 32;
+    } while (--length > 0);
+}
+
+void screen_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    const uint16x8_t one = vdupq_n_u16(1);
+
+    length /= 4;
+
+    do {
+        uint8x16_t d = vld1q_u8(dst);
+        uint8x16_t s = vld1q_u8(src);
+
+        uint16x8_t dst0 = vmovl_u8(vget_low_u8(d));
+        uint16x8_t dst1 = vmovl_u8(vget_high_u8(d));
+        uint16x8_t product0 = vshrq_n_u16(vmulq_u16(dst0, vaddw_u8(one, vget_low_u8(s))), 8);
+        uint16x8_t product1 = vshrq_n_u16(vmulq_u16(dst1, vaddw_u8(one, vget_high_u8(s))), 8);
+
+        dst0 = vsubq_u16(vaddw_u8(dst0, vget_low_u8(s)), product0);
+        dst1 = vsubq_u16(vaddw_u8(dst1, vget_high_u8(s)), product1);
+
+        vst1q_u8(dst, vcombine_u8(vmovn_u16(dst0), vmovn_u16(dst1)));
+        src += 16;
+        dst += 16;
+    } while (--length > 0);
+}
+
+void lighten_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    length /= 4;
+
+    do {
+        vst1q_u8(dst, vmaxq_u8(vld1q_u8(dst), vld1q_u8(src)));
+        src += 16;
+        dst += 16;
+    } while (--length > 0);
+}
+
+void darken_neon(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    length /= 4;
+
+    do {
+        vst1q_u8(dst, vminq_u8(vld1q_u8(dst), vld1q_u8(src)));
+        src += 16;
+        dst += 16;
+    } while (--length > 0);
+}
+
+void fade_neon(uint8_t * restrict dst, uint8_t alpha, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 8 == 0);            // we'll process entries 8 by 8 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+
+    const uint16x8_t factor = vdupq_n_u16((uint16_t)alpha + 1);
+
+    length /= 8;
+
+    do {
+        uint8x8x4_t d = vld4_u8(dst);
+
+        d.val[3] = vshrn_n_u16(vmulq_u16(vmovl_u8(d.val[3]), factor), 8);
+
+        vst4_u8(dst, d);
+        dst += 32;
+    } while (--length > 0);
+}
+
+void lerp_neon(uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    dst = (uint8_t * restrict)__builtin_assume_aligned(dst, 16);
+    src = (const uint8_t * restrict)__builtin_assume_aligned(src, 16);
+
+    const uint16_t weight = t != 0 ? (uint16_t)t + 1 : 0;
+    const uint16x8_t src_weight = vdupq_n_u16(weight);
+    const uint16x8_t dst_weight = vdupq_n_u16(256 - weight);
+
+    length /= 4;
+
+    do {
+        uint8x16_t d = vld1q_u8(dst);
+        uint8x16_t s = vld1q_u8(src);
+
+        uint8x8_t final0 = mix(vget_low_u8(d), vget_low_u8(s), dst_weight, src_weight);
+        uint8x8_t final1 = mix(vget_high_u8(d), vget_high_u8(s), dst_weight, src_weight);
+
+        vst1q_u8(dst, vcombine_u8(final0, final1));
+        src += 16;
+        dst += 16;
+    } while (--length > 0);
+}
+
+void copy_masked_neon(uint8_t * restrict dst, const uint8_t * restrict src,
+                      const uint8_t * restrict mask, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)src % 16 == 0);   // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)mask % 16 == 0);  // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    uint32_t * restrict dstv = (uint32_t *)__builtin_assume_aligned(dst, 16);
+    const uint32_t * restrict srcv = (const uint32_t *)__builtin_assume_aligned(src, 16);
+    const uint32_t * restrict maskv = (const uint32_t *)__builtin_assume_aligned(mask, 16);
+
+    const uint32x4_t alpha_bits = vdupq_n_u32(0xff000000);
+
+    length /= 4;
+
+    do {
+        /* copy is all ones for entries whose mask alpha is not zero */
+        uint32x4_t copy = vtstq_u32(vld1q_u32(maskv), alpha_bits);
+
+        vst1q_u32(dstv, vbslq_u32(copy, vld1q_u32(srcv), vld1q_u32(dstv)));
+        maskv += 4;
+        srcv += 4;
+        dstv += 4;
+    } while (--length > 0);
+}
@@ -17,6 +17,7 @@
 #include <assert.h>
 #include <stdint.h>
 #include "config.h"
+#include "accelerated_plain.h"
 
 void blend_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned length)
 {
@@ -28,11 +29,7 @@ void blend_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned leng
     b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
 
     do {
-        uint16_t alpha = b[3];
-        if (alpha != 0) { alpha += 1; }
-        a[0] = ((uint16_t)a[0] * ((uint16_t)256 - alpha) + (uint16_t)b[0] * alpha) / 256;
-        a[1] = ((uint16_t)a[1] * ((uint16_t)256 - alpha) + (uint16_t)b[1] * alpha) / 256;
-        a[2] = ((uint16_t)a[2] * ((uint16_t)256 - alpha) + (uint16_t)b[2] * alpha) / 256;
+        blend_color_plain(a, b);
         a += 4;
         b += 4;
     } while (--length > 0);
@@ -56,3 +53,137 @@ void multiply_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned l
         b += 4;
     } while (--length > 0);
 }
+
+void add_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    do {
+        uint16_t alpha = b[3];
+        if (alpha != 0) { alpha += 1; }
+        uint16_t red = (uint16_t)a[0] + (uint16_t)b[0] * alpha / 256;
+        uint16_t green = (uint16_t)a[1] + (uint16_t)b[1] * alpha / 256;
+        uint16_t blue = (uint16_t)a[2] + (uint16_t)b[2] * alpha / 256;
+        a[0] = red < 255 ? red : 255;
+        a[1] = green < 255 ? green : 255;
+        a[2] = blue < 255 ? blue : 255;
+        a += 4;
+        b += 4;
+    } while (--length > 0);
+}
+
+void screen_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    // Written as a + b - a * b, using same rounding as multiply, so it never overflows
+    length *= 4;
+    do {
+        *a = (uint16_t)*a + (uint16_t)*b - ((uint16_t)*a * ((uint16_t)*b + 1)) / 256;
+        a += 1;
+        b += 1;
+    } while (--length > 0);
+}
+
+void lighten_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    length *= 4;
+    do {
+        if (*b > *a) { *a = *b; }
+        a += 1;
+        b += 1;
+    } while (--length > 0);
+}
+
+void darken_plain(uint8_t * restrict a, const uint8_t * restrict b, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    length *= 4;
+    do {
+        if (*b < *a) { *a = *b; }
+        a += 1;
+        b += 1;
+    } while (--length > 0);
+}
+
+void fade_plain(uint8_t * restrict a, uint8_t alpha, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+
+    const uint16_t factor = (uint16_t)alpha + 1;
+    do {
+        a[3] = ((uint16_t)a[3] * factor) / 256;
+        a += 4;
+    } while (--length > 0);
+}
+
+void lerp_plain(uint8_t * restrict a, const uint8_t * restrict b, uint8_t t, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+
+    uint16_t weight = t;
+    if (weight != 0) { weight += 1; }
+
+    length *= 4;
+    do {
+        *a = ((uint16_t)*a * ((uint16_t)256 - weight) + (uint16_t)*b * weight) / 256;
+        a += 1;
+        b += 1;
+    } while (--length > 0);
+}
+
+void copy_masked_plain(uint8_t * restrict a, const uint8_t * restrict b,
+                       const uint8_t * restrict mask, unsigned length)
+{
+    assert((uintptr_t)a % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)b % 8 == 0);    // Not a requirement, but lets compiler optimize stuff
+    assert((uintptr_t)mask % 8 == 0); // Not a requirement, but lets compiler optimize stuff
+    assert(length != 0);              // allows inverting loop condition
+
+    a = (uint8_t * restrict)__builtin_assume_aligned(a, 8);
+    b = (const uint8_t * restrict)__builtin_assume_aligned(b, 8);
+    mask = (const uint8_t * restrict)__builtin_assume_aligned(mask, 8);
+
+    do {
+        if (mask[3] != 0) {
+            a[0] = b[0];
+            a[1] = b[1];
+            a[2] = b[2];
+            a[3] = b[3];
+        }
+        a += 4;
+        b += 4;
+        mask += 4;
+    } while (--length > 0);
+}
@@ -0,0 +1,36 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOOLS_ACCELERATED_PLAIN_H_7C51A2E9
+#define TOOLS_ACCELERATED_PLAIN_H_7C51A2E9
+
+#include <stdint.h>
+
+/* Per-color arithmetic of plain variants, for code that works on scattered
+ * colors and must give the same results as the streamed functions.
+ */
+
+/** Blends one R8G8B8A8 color b into a, see blend in accelerated.h */
+static inline void blend_color_plain(uint8_t * a, const uint8_t * b)
+{
+    uint16_t alpha = b[3];
+    if (alpha != 0) { alpha += 1; }
+    a[0] = ((uint16_t)a[0] * ((uint16_t)256 - alpha) + (uint16_t)b[0] * alpha) / 256;
+    a[1] = ((uint16_t)a[1] * ((uint16_t)256 - alpha) + (uint16_t)b[1] * alpha) / 256;
+    a[2] = ((uint16_t)a[2] * ((uint16_t)256 - alpha) + (uint16_t)b[2] * alpha) / 256;
+}
+
+#endif
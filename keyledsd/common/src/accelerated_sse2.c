@@ -92,8 +92,8 @@ void multiply_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigne
         __m128i src0 = _mm_unpacklo_epi8(packed_src, zero); /* A1B1G1R1A0B0G0R0 */
         __m128i src1 = _mm_unpackhi_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2 */
 
-        dst0 = _mm_mullo_epi16(src0, _mm_add_epi16(dst0, one));
-        dst1 = _mm_mullo_epi16(src1, _mm_add_epi16(dst1, one));
+        dst0 = _mm_mullo_epi16(dst0, _mm_add_epi16(src0, one));
+        dst1 = _mm_mullo_epi16(dst1, _mm_add_epi16(src1, one));
 
         dst0 = _mm_srli_epi16(dst0, 8);
         dst1 = _mm_srli_epi16(dst1, 8);
@@ -103,3 +103,228 @@ void multiply_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigne
         dstv += 1;
     } while (--length > 0);
 }
+
+void add_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+        __m128i packed_src = _mm_load_si128(srcv);
+
+        __m128i dst0 = _mm_unpacklo_epi8(packed_dst, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i dst1 = _mm_unpackhi_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2 */
+        __m128i src0 = _mm_unpacklo_epi8(packed_src, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i src1 = _mm_unpackhi_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2 */
+
+        __m128i alpha0 = _mm_shufflelo_epi16(_mm_shufflehi_epi16(src0, 0xff), 0xff);
+        alpha0 = _mm_add_epi16(alpha0, _mm_add_epi16(_mm_cmpeq_epi16(alpha0, zero), one));
+        __m128i alpha1 = _mm_shufflelo_epi16(_mm_shufflehi_epi16(src1, 0xff), 0xff);
+        alpha1 = _mm_add_epi16(alpha1, _mm_add_epi16(_mm_cmpeq_epi16(alpha1, zero), one));
+
+        __m128i weighted_src0 = _mm_srli_epi16(_mm_mullo_epi16(src0, alpha0), 8);
+        __m128i weighted_src1 = _mm_srli_epi16(_mm_mullo_epi16(src1, alpha1), 8);
+
+        /* packus saturates the sum to 255 */
+        _mm_store_si128(dstv, _mm_packus_epi16(_mm_add_epi16(dst0, weighted_src0),
+                                               _mm_add_epi16(dst1, weighted_src1)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void screen_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+        __m128i packed_src = _mm_load_si128(srcv);
+
+        __m128i dst0 = _mm_unpacklo_epi8(packed_dst, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i dst1 = _mm_unpackhi_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2 */
+        __m128i src0 = _mm_unpacklo_epi8(packed_src, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i src1 = _mm_unpackhi_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2 */
+
+        __m128i product0 = _mm_srli_epi16(_mm_mullo_epi16(dst0, _mm_add_epi16(src0, one)), 8);
+        __m128i product1 = _mm_srli_epi16(_mm_mullo_epi16(dst1, _mm_add_epi16(src1, one)), 8);
+
+        dst0 = _mm_sub_epi16(_mm_add_epi16(dst0, src0), product0);
+        dst1 = _mm_sub_epi16(_mm_add_epi16(dst1, src1), product1);
+
+        _mm_store_si128(dstv, _mm_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lighten_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    length /= 4;
+
+    do {
+        _mm_store_si128(dstv, _mm_max_epu8(_mm_load_si128(dstv), _mm_load_si128(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void darken_sse2(uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    length /= 4;
+
+    do {
+        _mm_store_si128(dstv, _mm_min_epu8(_mm_load_si128(dstv), _mm_load_si128(srcv)));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void fade_sse2(uint8_t * restrict dst, uint8_t alpha, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const short factor = (short)alpha + 1;
+    /* Color channels are multiplied by 256, alpha channel by factor */
+    const __m128i factors = _mm_set_epi16(factor, 256, 256, 256, factor, 256, 256, 256);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+
+        __m128i dst0 = _mm_unpacklo_epi8(packed_dst, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i dst1 = _mm_unpackhi_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2 */
+
+        dst0 = _mm_srli_epi16(_mm_mullo_epi16(dst0, factors), 8);
+        dst1 = _mm_srli_epi16(_mm_mullo_epi16(dst1, factors), 8);
+
+        _mm_store_si128(dstv, _mm_packus_epi16(dst0, dst1));
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void lerp_sse2(uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const short weight = t != 0 ? (short)t + 1 : 0;
+    const __m128i src_weight = _mm_set1_epi16(weight);
+    const __m128i dst_weight = _mm_set1_epi16(256 - weight);
+
+    length /= 4;
+
+    do {
+        __m128i packed_dst = _mm_load_si128(dstv);
+        __m128i packed_src = _mm_load_si128(srcv);
+
+        __m128i dst0 = _mm_unpacklo_epi8(packed_dst, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i dst1 = _mm_unpackhi_epi8(packed_dst, zero); /* A3B3G3R3A2B2G2R2 */
+        __m128i src0 = _mm_unpacklo_epi8(packed_src, zero); /* A1B1G1R1A0B0G0R0 */
+        __m128i src1 = _mm_unpackhi_epi8(packed_src, zero); /* A3B3G3R3A2B2G2R2 */
+
+        dst0 = _mm_add_epi16(_mm_mullo_epi16(dst0, dst_weight), _mm_mullo_epi16(src0, src_weight));
+        dst1 = _mm_add_epi16(_mm_mullo_epi16(dst1, dst_weight), _mm_mullo_epi16(src1, src_weight));
+
+        dst0 = _mm_srli_epi16(dst0, 8);
+        dst1 = _mm_srli_epi16(dst1, 8);
+
+        _mm_store_si128(dstv, _mm_packus_epi16(dst0, dst1));
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
+
+void copy_masked_sse2(uint8_t * restrict dst, const uint8_t * restrict src,
+                      const uint8_t * restrict mask, unsigned length)
+{
+    assert((uintptr_t)dst % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)src % 16 == 0);   // SSE2 requires 16-bytes aligned data
+    assert((uintptr_t)mask % 16 == 0);  // SSE2 requires 16-bytes aligned data
+    assert(length != 0);                // allows inverting loop condition, makes gcc generate
+                                        // better loop code
+    assert(length % 4 == 0);            // we'll process entries 4 by 4 and don't want to be
+                                        // slowed by boundary checks
+
+    __m128i * restrict dstv = (__m128i *)__builtin_assume_aligned(dst, 16);
+    const __m128i * restrict srcv = (const __m128i *)__builtin_assume_aligned(src, 16);
+    const __m128i * restrict maskv = (const __m128i *)__builtin_assume_aligned(mask, 16);
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_bits = _mm_set1_epi32((int)0xff000000);
+
+    length /= 4;
+
+    do {
+        /* keep is all ones for entries whose mask alpha is zero */
+        __m128i keep = _mm_cmpeq_epi32(_mm_and_si128(_mm_load_si128(maskv), alpha_bits), zero);
+
+        _mm_store_si128(dstv, _mm_or_si128(_mm_and_si128(keep, _mm_load_si128(dstv)),
+                                           _mm_andnot_si128(keep, _mm_load_si128(srcv))));
+        maskv += 1;
+        srcv += 1;
+        dstv += 1;
+    } while (--length > 0);
+}
@@ -0,0 +1,234 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks every accelerated kernel the running CPU supports against its plain C
+ * variant, bit for bit, on random data. Lengths are odd multiples of the widest
+ * block, so buffers end in partial cache lines, and the bytes past the end of
+ * every buffer must be left untouched. Kernels that leave the destination alpha
+ * channel undefined, as documented in accelerated.h, are not checked on it.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#ifdef HAVE_GETAUXVAL
+#  include <sys/auxv.h>
+#endif
+
+#define BLOCK       16          /* colors, widest variant's requirement */
+#define MAX_LENGTH  (BLOCK * 37)
+#define GUARD       64          /* bytes checked past end of buffers */
+#define ROUNDS      64
+
+/****************************************************************************/
+/* Variant declarations, see accelerated.c */
+
+#define STREAM_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, unsigned length)
+#define FADE_PARAMS (uint8_t * restrict dst, uint8_t alpha, unsigned length)
+#define LERP_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, uint8_t t, unsigned length)
+#define MASKED_PARAMS (uint8_t * restrict dst, const uint8_t * restrict src, \
+                       const uint8_t * restrict mask, unsigned length)
+
+#define DECLARE_VARIANTS(name, params) \
+    void name##_avx512 params; \
+    void name##_avx2 params; \
+    void name##_sse2 params; \
+    void name##_neon params; \
+    void name##_plain params;
+
+DECLARE_VARIANTS(blend, STREAM_PARAMS)
+DECLARE_VARIANTS(multiply, STREAM_PARAMS)
+DECLARE_VARIANTS(add, STREAM_PARAMS)
+DECLARE_VARIANTS(screen, STREAM_PARAMS)
+DECLARE_VARIANTS(lighten, STREAM_PARAMS)
+DECLARE_VARIANTS(darken, STREAM_PARAMS)
+DECLARE_VARIANTS(fade, FADE_PARAMS)
+DECLARE_VARIANTS(lerp, LERP_PARAMS)
+DECLARE_VARIANTS(copy_masked, MASKED_PARAMS)
+
+typedef void (*stream_fn) STREAM_PARAMS;
+typedef void (*fade_fn) FADE_PARAMS;
+typedef void (*lerp_fn) LERP_PARAMS;
+typedef void (*masked_fn) MASKED_PARAMS;
+
+/** All kernels of one instruction set */
+struct variant {
+    const char *    name;
+    int             supported;
+    stream_fn       blend, multiply, add, screen, lighten, darken;
+    fade_fn         fade;
+    lerp_fn         lerp;
+    masked_fn       copy_masked;
+};
+
+#define VARIANT(suffix, supported) { #suffix, supported, \
+    blend_##suffix, multiply_##suffix, add_##suffix, screen_##suffix, \
+    lighten_##suffix, darken_##suffix, fade_##suffix, lerp_##suffix, copy_masked_##suffix }
+
+/****************************************************************************/
+/* Test data */
+
+static uint32_t random_state = 0x2545F491u;
+
+static uint8_t random_byte(void)
+{
+    /* xorshift32, so runs are reproducible */
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return (uint8_t)(random_state >> 24);
+}
+
+static void fill_random(uint8_t * buffer, unsigned size)
+{
+    for (unsigned idx = 0; idx < size; ++idx) {
+        buffer[idx] = random_byte();
+        /* Favor edge values, where rounding errors show up */
+        if ((idx & 7) == 0) { buffer[idx] = (idx & 8) ? 255 : 0; }
+    }
+}
+
+static uint8_t * alloc_buffer(void)
+{
+    uint8_t * buffer = aligned_alloc(64, MAX_LENGTH * 4 + GUARD);
+    if (buffer == NULL) { perror("aligned_alloc"); exit(2); }
+    return buffer;
+}
+
+static uint8_t * src, * mask, * expected, * actual, * initial;
+static int failures = 0;
+
+static void check(const char * variant, const char * kernel, unsigned length,
+                  int alpha_defined)
+{
+    if (memcmp(expected, actual, length * 4 + GUARD) == 0) { return; }
+    for (unsigned idx = 0; idx < length * 4 + GUARD; ++idx) {
+        if (!alpha_defined && idx < length * 4 && idx % 4 == 3) { continue; }
+        if (expected[idx] != actual[idx]) {
+            fprintf(stderr, "%s_%s: length %u, byte %u (%s): expected %u, got %u\n",
+                    kernel, variant, length, idx, idx < length * 4 ? "data" : "guard",
+                    expected[idx], actual[idx]);
+            ++failures;
+            return;
+        }
+    }
+}
+
+/** Resets both destinations to the same random data, guard included */
+static void reset(unsigned length)
+{
+    memcpy(expected, initial, length * 4 + GUARD);
+    memcpy(actual, initial, length * 4 + GUARD);
+}
+
+/****************************************************************************/
+
+static void test_variant(const struct variant * plain, const struct variant * variant)
+{
+    static const char * const stream_names[] = {
+        "blend", "multiply", "add", "screen", "lighten", "darken"
+    };
+    static const int stream_alpha_defined[] = { 0, 1, 0, 1, 1, 1 };
+    const stream_fn plain_stream[] = {
+        plain->blend, plain->multiply, plain->add, plain->screen, plain->lighten, plain->darken
+    };
+    const stream_fn variant_stream[] = {
+        variant->blend, variant->multiply, variant->add,
+        variant->screen, variant->lighten, variant->darken
+    };
+
+    for (unsigned round = 0; round < ROUNDS; ++round) {
+        const unsigned length = BLOCK * (2 * (round % 18) + 1);
+        fill_random(initial, MAX_LENGTH * 4 + GUARD);
+        fill_random(src, MAX_LENGTH * 4 + GUARD);
+        fill_random(mask, MAX_LENGTH * 4 + GUARD);
+        const uint8_t weight = random_byte();
+
+        for (unsigned op = 0; op < sizeof(stream_names) / sizeof(stream_names[0]); ++op) {
+            reset(length);
+            plain_stream[op](expected, src, length);
+            variant_stream[op](actual, src, length);
+            check(variant->name, stream_names[op], length, stream_alpha_defined[op]);
+        }
+
+        reset(length);
+        plain->fade(expected, weight, length);
+        variant->fade(actual, weight, length);
+        check(variant->name, "fade", length, 1);
+
+        reset(length);
+        plain->lerp(expected, src, weight, length);
+        variant->lerp(actual, src, weight, length);
+        check(variant->name, "lerp", length, 1);
+
+        reset(length);
+        plain->copy_masked(expected, src, mask, length);
+        variant->copy_masked(actual, src, mask, length);
+        check(variant->name, "copy_masked", length, 1);
+    }
+}
+
+int main(void)
+{
+#if defined HAVE_BUILTIN_CPU_SUPPORTS && defined __GNUC__ && !defined __clang__
+    __builtin_cpu_init();
+#endif
+    const struct variant plain = VARIANT(plain, 1);
+    const struct variant variants[] = {
+#ifdef KEYLEDSD_USE_AVX512
+        VARIANT(avx512, __builtin_cpu_supports("avx512bw")),
+#endif
+#ifdef KEYLEDSD_USE_AVX2
+        VARIANT(avx2, __builtin_cpu_supports("avx2")),
+#endif
+#ifdef KEYLEDSD_USE_SSE2
+        VARIANT(sse2, __builtin_cpu_supports("sse2")),
+#endif
+#ifdef KEYLEDSD_USE_NEON
+#  if defined __aarch64__
+        VARIANT(neon, (getauxval(AT_HWCAP) & HWCAP_ASIMD) != 0),
+#  else
+        VARIANT(neon, (getauxval(AT_HWCAP) & HWCAP_ARM_NEON) != 0),
+#  endif
+#endif
+        { NULL, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+    };
+
+    src = alloc_buffer();
+    mask = alloc_buffer();
+    expected = alloc_buffer();
+    actual = alloc_buffer();
+    initial = alloc_buffer();
+
+    for (const struct variant * variant = variants; variant->name; ++variant) {
+        if (!variant->supported) {
+            printf("%s: not supported by this CPU, skipped\n", variant->name);
+            continue;
+        }
+        const int before = failures;
+        test_variant(&plain, variant);
+        printf("%s: %s\n", variant->name, failures == before ? "ok" : "FAILED");
+    }
+
+    free(initial);
+    free(actual);
+    free(expected);
+    free(mask);
+    free(src);
+    return failures == 0 ? 0 : 1;
+}
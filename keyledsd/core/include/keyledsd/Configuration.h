@@ -20,6 +20,7 @@
 #include <memory>
 #include <regex>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -47,10 +48,18 @@ public:
     using key_group_list = std::vector<KeyGroup>;
     using effect_group_list = std::vector<EffectGroup>;
     using profile_list = std::vector<Profile>;
+    using string_map = std::vector<std::pair<std::string, std::string>>;
+    using lookup_values = std::vector<const std::string *>;
+
+    static constexpr unsigned defaultContextDebounce = 50;  ///< Milliseconds
 private:
                             Configuration(std::string path,
                                           string_list plugins,
                                           path_list pluginPaths,
+                                          unsigned renderThreads,
+                                          bool measureLatency,
+                                          unsigned contextDebounce,
+                                          bool preloadEffects,
                                           device_map devices,
                                           key_group_list groups,
                                           effect_group_list effectGroups,
@@ -62,11 +71,19 @@ public:
     const std::string &     path() const { return m_path; }
     const string_list       plugins() const { return m_plugins; }
     const path_list &       pluginPaths() const { return m_pluginPaths; }
+    unsigned                renderThreads() const { return m_renderThreads; }
+    bool                    measureLatency() const { return m_measureLatency; }
+    unsigned                contextDebounce() const { return m_contextDebounce; }
+    bool                    preloadEffects() const { return m_preloadEffects; }
     const device_map &      devices() const { return m_devices; }
     const key_group_list &  keyGroups() const { return m_keyGroups; }
     const effect_group_list & effectGroups() const { return m_effectGroups; }
     const profile_list&     profiles() const { return m_profiles; }
 
+    /// Resolves, in one pass over context, the values of all keys used by profile lookups.
+    /// The result can be matched against any profile's lookup.
+    lookup_values           lookupValues(const string_map & context) const;
+
 public:
     static std::unique_ptr<Configuration>   loadFile(const std::string & path);
 
@@ -74,10 +91,16 @@ private:
     std::string             m_path;         ///< Configuration file path, if loaded from disk
     string_list             m_plugins;      ///< List of plugins to load on startup
     path_list               m_pluginPaths;  ///< List of directories to search for plugins
+    unsigned                m_renderThreads = 0; ///< Worker threads per device rendering layers
+    bool                    m_measureLatency = false; ///< Measure key press to frame latency
+    unsigned                m_contextDebounce = defaultContextDebounce; ///< Milliseconds to coalesce
+                                                                        ///  window context changes
+    bool                    m_preloadEffects = false; ///< Load all effects before they are needed
     device_map              m_devices;      ///< Map of device serials to device names
     key_group_list          m_keyGroups;    ///< Map of key group names to lists of key names
     effect_group_list       m_effectGroups; ///< Map of effect group names to configurations
     profile_list            m_profiles;     ///< List of profile configurations
+    std::unordered_map<std::string, unsigned> m_lookupKeys; ///< Slot of each key used by lookups
 };
 
 /****************************************************************************/
@@ -99,6 +122,10 @@ public:
     const key_group_list &  keyGroups() const { return m_keyGroups; }
     const effect_list &     effects() const { return m_effects; }
 
+    /// Tells whether both groups define the same keys and effects
+    bool                    operator==(const EffectGroup &) const;
+    bool                    operator!=(const EffectGroup & other) const { return !(*this == other); }
+
 private:
     std::string             m_name;         ///< User-readable name
     key_group_list          m_keyGroups;    ///< Map of key group names to lists of key names
@@ -120,6 +147,9 @@ public:
     const std::string &     name() const { return m_name; }
     const key_list &        keys() const { return m_keys; }
 
+    bool                    operator==(const KeyGroup &) const;
+    bool                    operator!=(const KeyGroup & other) const { return !(*this == other); }
+
 private:
     std::string             m_name;         ///< User-readable name
     key_list                m_keys;         ///< List of key names
@@ -138,21 +168,31 @@ class Configuration::Profile final
 {
 public:
     /// Filters a context to determine whether a profile should be enabled
+    /// Filters are regular expressions. Common shapes, such as plain strings or
+    /// strings with leading or trailing wildcards, are matched without running
+    /// the regex engine.
     class Lookup final
     {
         struct Entry;
         using entry_list = std::vector<Entry>;
         using string_map = std::vector<std::pair<std::string, std::string>>;
+        using lookup_values = std::vector<const std::string *>;
     public:
                             Lookup() = default;
                             Lookup(string_map filters);
                             ~Lookup();
 
         bool                match(const string_map &) const;
+        /// Matches values resolved by Configuration::lookupValues
+        bool                match(const lookup_values &) const;
     private:
         static entry_list   buildRegexps(string_map);
+        /// Assigns every entry the slot of its key, adding unknown keys
+        void                bindKeys(std::unordered_map<std::string, unsigned> &);
     private:
         entry_list  m_entries;
+
+        friend class Configuration;
     };
 
     using device_list = std::vector<std::string>;
@@ -174,6 +214,8 @@ private:
     Lookup                  m_lookup;       ///< Determines when to apply the profile
     device_list             m_devices;      ///< List of device names this profile is restricted to
     effect_group_list       m_effectGroups; ///< List of effect group names this profile activates
+
+    friend class Configuration;
 };
 
 /****************************************************************************/
@@ -191,6 +233,9 @@ public:
                         ~Effect();
     const std::string & name() const { return m_name; }
     const string_map &  items() const { return m_items; }
+
+    bool                operator==(const Effect &) const;
+    bool                operator!=(const Effect & other) const { return !(*this == other); }
 private:
     std::string         m_name;         ///< Effect name as registered in effect manager
     string_map          m_items;        ///< Flat string map passed through to effect
@@ -0,0 +1,76 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEYLEDSD_LATENCY_STATS_H_8F31C0A7
+#define KEYLEDSD_LATENCY_STATS_H_8F31C0A7
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+namespace keyleds {
+
+/****************************************************************************/
+
+/** Latency histogram
+ *
+ * Counts durations into buckets of doubling width, starting at 250µs. One thread
+ * records samples while others read them, without locking. A reader may see a
+ * sample in the total count before it appears in its bucket, which is good
+ * enough for statistics.
+ */
+class LatencyStats final
+{
+public:
+    using duration = std::chrono::microseconds;
+    static constexpr unsigned bucketCount = 14;
+
+    /// Consistent copy of statistics, for reporting
+    struct Summary final
+    {
+        std::array<unsigned long, bucketCount> buckets; ///< Sample count per bucket
+        unsigned long   count;          ///< Total number of samples
+        unsigned long   expired;        ///< Events that timed out without a sample
+        duration        total;          ///< Sum of all samples
+        duration        max;            ///< Longest sample
+
+        duration        mean() const;
+        duration        percentile(unsigned pct) const;   ///< Bucket upper bound, capped to max
+    };
+public:
+                        LatencyStats();
+
+    /// Upper bound of a bucket. Last bucket has no upper bound, duration::max() is returned.
+    static duration     bucketLimit(unsigned idx);
+
+    void                record(duration);   ///< Adds a sample
+    void                expire();           ///< Counts an event that produced no sample
+    Summary             summary() const;
+    void                reset();
+
+private:
+    std::array<std::atomic<unsigned long>, bucketCount> m_buckets;  ///< Sample count per bucket
+    std::atomic<unsigned long>  m_count;    ///< Total number of samples
+    std::atomic<unsigned long>  m_expired;  ///< Events that timed out without a sample
+    std::atomic<unsigned long>  m_total;    ///< Sum of all samples, in microseconds
+    std::atomic<unsigned long>  m_max;      ///< Longest sample, in microseconds
+};
+
+/****************************************************************************/
+
+} // namespace keyleds
+
+#endif
@@ -17,11 +17,22 @@
 #ifndef KEYLEDS_RENDER_LOOP_H_D7E4709F
 #define KEYLEDS_RENDER_LOOP_H_D7E4709F
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include "keyledsd/Device.h"
+#include "keyledsd/KeyDatabase.h"
+#include "keyledsd/LatencyStats.h"
 #include "keyledsd/RenderTarget.h"
 #include "tools/AnimationLoop.h"
+#include "tools/SPSCQueue.h"
 
 namespace keyleds {
 
@@ -33,23 +44,97 @@ namespace keyleds {
  * RenderTarget state to a Device. It assumes entire control of the device.
  * That is, no other thread is allowed to call Device's manipulation methods
  * while a RenderLoop for it exists.
+ *
+ * Optionally, layer-independent renderers can be run concurrently on a pool of
+ * worker threads. Their layers are then blended in renderer order, so the result
+ * is the same as rendering them serially.
+ *
+ * The renderer list is published as an immutable snapshot, which the render
+ * thread picks up at the start of every frame. Replacing it never waits for
+ * the current frame to complete, and the render thread never waits for it.
+ * Likewise, the worker pool is resized by the render thread between frames.
+ *
+ * Input events are queued without locking, and delivered by the render thread
+ * at the start of next frame, in order, to the event function of the current
+ * renderer list. The main thread and an input reader thread each get a queue.
+ *
+ * Optionally, the loop measures the time between a key press and the commit of
+ * the first frame that changes that key's color.
  */
 class RenderLoop final : public tools::AnimationLoop
 {
+public:
     using renderer_list = std::vector<Renderer *>;
+    using prepare_function = std::function<void()>;
+    using string_map = std::vector<std::pair<std::string, std::string>>;
+
+    /// Input event, queued for delivery on the render thread
+    struct Event final
+    {
+        enum class Type { Key, Generic };
+        using clock = std::chrono::steady_clock;
+
+        Type                type;       ///< Tells which fields below are set
+        clock::time_point   time;       ///< When the event was posted
+        const KeyDatabase::Key * key;   ///< Key event: key that was pressed or released
+        bool                press;      ///< Key event: whether the key was pressed
+        string_map          values;     ///< Generic event: event values
+    };
+    using event_function = std::function<void(const Event &)>;
+
+    static constexpr std::size_t eventQueueSize = 256;  ///< Events posted between two frames
+    static constexpr std::size_t maxPendingKeys = 64;   ///< Key presses tracked for latency
+    static constexpr std::chrono::seconds latencyTimeout{1};    ///< Forget key presses after that
+    static constexpr unsigned long latencyLogInterval = 100;    ///< Samples between log reports
+private:
+    /// Immutable renderer list, as seen by the render thread
+    struct Snapshot final
+    {
+        unsigned long       generation;     ///< Increases with every published snapshot
+        renderer_list       renderers;      ///< Renderers to run, in order (unowned)
+        prepare_function    prepare;        ///< Invoked by render thread before first use
+        event_function      handleEvent;    ///< Invoked by render thread for every event
+    };
+    using snapshot_ptr = std::shared_ptr<const Snapshot>;
 public:
                         RenderLoop(Device &, unsigned fps);
                         ~RenderLoop() override;
 
-    /// Returns a lock that bars the render loop from using renderers while it is held
-    /// Holding it is mandatory for modifying any renderer or the list itself
-    std::unique_lock<std::mutex>    lock();
+    /// Publishes a new renderer list, without waiting for current frame to complete.
+    /// The list only holds pointers, which must remain valid until they are removed
+    /// with clearRenderers. RenderLoop will not destroy them or interact in any way but
+    /// calling their render methods. If set, prepare is invoked once on the render
+    /// thread before the list is first rendered. It is dropped if the list is replaced
+    /// before that. If set, handleEvent receives input events while the list is current.
+    void                setRenderers(renderer_list, prepare_function = nullptr,
+                                     event_function handleEvent = nullptr);
+
+    /// Publishes an empty renderer list, then waits until the render thread releases
+    /// previous ones. Renderers can safely be destroyed once it returns.
+    void                clearRenderers();
 
-    /// Renderer list accessor. When using it to modify renderers, a lock must be held.
-    /// The list only holds pointers, which must be valid as long as they remain
-    /// in the list. RenderLoop will not destroy them or interact in any way but
-    /// calling their render method.
-    renderer_list &     renderers() { return m_renderers; }
+    /// Sets the number of worker threads used to render layer-independent renderers.
+    /// Zero disables concurrent rendering. Takes effect at the start of next frame.
+    void                setRenderThreads(unsigned);
+
+    /// Queues a key event for delivery on next frame. Returns false if the queue is full.
+    /// Must always be called from the same thread as postGenericEvent.
+    bool                postKeyEvent(const KeyDatabase::Key &, bool press,
+                                     Event::clock::time_point time = Event::clock::now());
+    /// Queues a generic event for delivery on next frame. Returns false if the queue is full.
+    /// Must always be called from the same thread as postKeyEvent.
+    bool                postGenericEvent(string_map values);
+    /// Queues a key event for delivery on next frame. Returns false if the queue is full.
+    /// Must always be called from the same thread, for instance an input reader thread.
+    bool                postInputKeyEvent(const KeyDatabase::Key &, bool press,
+                                          Event::clock::time_point time);
+
+    /// Enables or disables key latency measurement. Statistics are kept when disabled.
+    void                setMeasureLatency(bool);
+    bool                measureLatency() const { return m_measureLatency; }
+    /// Key latency statistics. Only updated while measurement is enabled.
+    LatencyStats &      latencyStats() { return m_latency; }
+    const LatencyStats & latencyStats() const { return m_latency; }
 
     /// Creates a new render target matching the layout of given device
     static RenderTarget renderTargetFor(const Device &);
@@ -58,19 +143,75 @@ private:
     bool                render(unsigned long) override;
     void                run() override;
 
+    /// Queues an event, or counts it as dropped
+    bool                postEvent(tools::SPSCQueue<Event> &, Event &&);
+    /// Delivers queued events to given function, or drops them if it is not set
+    void                dispatchEvents(const event_function &);
+
+    /// Matches pending key presses against the frame about to be committed
+    void                updateLatency(bool committed);
+
     /// Reads current device led state into the render target
     void                getDeviceState(RenderTarget & state);
 
+    /// Renders one frame with given renderer list and sends it to the device
+    void                renderFrame(const Snapshot &, unsigned long);
+    /// Drops render thread's reference to a snapshot, waking up clearRenderers
+    void                releaseSnapshot(snapshot_ptr &);
+
+    /// Replaces worker threads with given number of new ones
+    void                resizeWorkers(unsigned count);
+    /// Runs renderLayer on all renderers, using worker threads
+    void                renderLayers(const renderer_list &, unsigned long);
+    /// Runs renderLayer on renderers not yet picked by another thread
+    void                runLayerJobs();
+    /// Entry point for worker threads, starting after given frame
+    void                workerEntry(unsigned long frame);
+
 private:
     Device &            m_device;               ///< The device to render to
-    renderer_list       m_renderers;            ///< Current list of renderers (unowned)
-    std::mutex          m_mRenderers;           ///< Controls access to m_renderers
+    snapshot_ptr        m_renderers;            ///< Current renderer list, only accessed atomically
+    unsigned long       m_generation;           ///< Generation of last published snapshot
+    unsigned long       m_renderedGeneration;   ///< Generation of last snapshot seen by render thread
+    std::mutex          m_mReleased;            ///< Controls access to m_cReleased
+    std::condition_variable m_cReleased;        ///< Signals render thread released a snapshot
+
+    tools::SPSCQueue<Event> m_events;           ///< Events posted since last frame
+    tools::SPSCQueue<Event> m_inputEvents;      ///< Events posted since last frame by input thread
+    std::atomic<unsigned long> m_droppedEvents; ///< Events lost because queue was full
+
+    /// A key press waiting for the key's color to change
+    struct PendingKey final
+    {
+        RenderTarget::size_type index;          ///< Key index in render targets
+        Event::clock::time_point time;          ///< When the key was pressed
+    };
+    std::atomic<bool>   m_measureLatency;       ///< If set, key presses are tracked
+    std::vector<PendingKey> m_pendingKeys;      ///< Key presses not seen in a frame yet
+    LatencyStats        m_latency;              ///< Key press to frame commit latencies
+    unsigned long       m_latencyLogged;        ///< Sample count at last log report
 
     RenderTarget        m_state;                ///< Current state of the device
     RenderTarget        m_buffer;               ///< Buffer to render into, avoids re-creating it
                                                 ///  on every render
     std::vector<Device::ColorDirective> m_directives;   ///< Buffer of directives, avoids new/delete on
                                                         ///< every render
+
+    std::atomic<unsigned> m_renderThreads;      ///< Requested worker count, see setRenderThreads
+    std::vector<std::thread> m_workers;         ///< Threads rendering layers concurrently,
+                                                ///  only used by render thread once it runs
+    std::mutex          m_mWorkers;             ///< Controls access to worker state below
+    std::condition_variable m_cWorkers;         ///< Signals new frame or stop to workers
+    std::condition_variable m_cWorkersDone;     ///< Signals all workers finished current frame
+    unsigned long       m_frame;                ///< Frame counter, workers wait for it to change
+    unsigned            m_busyWorkers;          ///< Number of workers still rendering current frame
+    bool                m_stopWorkers;          ///< If set, workers exit
+    const renderer_list * m_layerRenderers;     ///< Renderers of current frame, for workers
+    unsigned long       m_layerTime;            ///< Time argument for current frame's renderLayer
+    std::atomic<unsigned> m_nextLayer;          ///< Index of next renderer to pick for renderLayer
+    std::vector<const RenderTarget *> m_layers; ///< Results of renderLayer for current frame
+    std::vector<char>   m_layerFailed;          ///< Set for renderers whose renderLayer threw, char
+                                                ///  rather than bool so threads can set entries
 };
 
 /****************************************************************************/
@@ -18,9 +18,13 @@
 #define LOGGING_H_2BAC1A63
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
+#include "tools/MPSCQueue.h"
 
 /****************************************************************************/
 
@@ -56,6 +60,10 @@ public:
     /// to using global policy.
     void    setPolicy(const std::string & name, const Policy *);
 
+    /// Revert global policy and loggers using given policy to defaults. Invoked by
+    /// policies that unregister themselves when destroyed.
+    void    releasePolicy(const Policy *);
+
     const Policy & globalPolicy() const { return *m_globalPolicy; }
 
 private:
@@ -98,6 +106,11 @@ public:
                     FilePolicy(int fd, level_t, bool ownsFd = false);
     virtual         ~FilePolicy();
     void            write(level_t, const std::string &, const std::string &) const override;
+protected:
+    /// Builds the complete line for a log entry, including trailing newline
+    std::string     format(level_t, const std::string & name, const std::string & msg) const;
+    /// Writes data to the file descriptor, retrying partial writes
+    void            writeData(const std::string &) const;
 protected:
     const int       m_fd;           ///< File descriptor number
     bool            m_ownsFd;       ///< Whether to close(2) m_fd on destruction
@@ -105,6 +118,41 @@ protected:
     level_t         m_minLevel;     ///< Minimum log level to write
 };
 
+/****************************************************************************/
+
+/** Logger policy that writes into a system file descriptor from a background thread
+ *
+ * Entries are formatted by the logging thread, then pushed into a lock-free queue,
+ * so logging never waits on the file descriptor. A background thread writes queued
+ * entries in batches. Entries that do not fit in the queue are dropped and counted,
+ * and a warning with the count is written once there is room again.
+ *
+ * Entries still queued on destruction are written before it returns. It also
+ * releases itself from the logging configuration then, so loggers fall back to
+ * the default policy instead of using a destroyed one. Forked
+ * processes do not have the writer thread, so they write entries directly.
+ */
+class AsyncFilePolicy final : public FilePolicy
+{
+public:
+                    AsyncFilePolicy(int fd, level_t, std::size_t capacity = 1024,
+                                    bool ownsFd = false);
+                    ~AsyncFilePolicy();
+    void            write(level_t, const std::string &, const std::string &) const override;
+
+    unsigned long   dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    void            run();              ///< Writer thread entry point
+private:
+    mutable tools::MPSCQueue<std::string> m_queue;  ///< Formatted entries waiting to be written
+    mutable std::atomic<unsigned long> m_dropped;   ///< Entries dropped because queue was full
+    mutable std::mutex  m_mutex;        ///< Writer thread sleeps on it, not taken by loggers
+    mutable std::condition_variable m_wakeup;       ///< Wakes writer thread up
+    std::atomic<bool>   m_stop;         ///< Tells writer thread to flush queue and exit
+    std::thread         m_thread;       ///< Writer thread
+};
+
 /*****************************************************************************
 * Logger
 *****************************************************************************/
@@ -122,6 +170,7 @@ public:
                     ~Logger();
 
     const std::string & name() const { return m_name; }
+    const Policy *  policy() const { return m_policy.load(); }
     void            setPolicy(const Policy * policy);
 
     void            print(level_t, const std::string & msg);
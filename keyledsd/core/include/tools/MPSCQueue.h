@@ -0,0 +1,126 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOOLS_MPSC_QUEUE_H_E4A07C39
+#define TOOLS_MPSC_QUEUE_H_E4A07C39
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace tools {
+
+/****************************************************************************/
+
+/** Bounded multiple-producer single-consumer queue
+ *
+ * A fixed-size ring buffer that any number of threads push into while another
+ * pops from it, without locking. Each slot carries a sequence number telling
+ * whether it is free for the position a producer claimed, or holds a value for
+ * the position the consumer expects. As with SPSCQueue, slots are created once
+ * and values are moved in and out of them.
+ *
+ * Any thread may push, and exactly one thread may pop.
+ */
+template <typename T> class MPSCQueue final
+{
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+public:
+    /// Creates a queue holding at least capacity values
+    explicit        MPSCQueue(size_type capacity)
+                     : m_slots(roundCapacity(capacity)), m_mask(m_slots.size() - 1),
+                       m_head(0), m_tail(0)
+                    {
+                        for (size_type idx = 0; idx < m_slots.size(); ++idx) {
+                            m_slots[idx].sequence.store(idx, std::memory_order_relaxed);
+                        }
+                    }
+                    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue &     operator=(const MPSCQueue &) = delete;
+
+    size_type       capacity() const noexcept { return m_slots.size(); }
+
+    /// Moves a value into the queue. Returns false and leaves value alone if queue is full.
+    /// May be called from any thread.
+    bool            push(value_type && value)
+    {
+        auto tail = m_tail.load(std::memory_order_relaxed);
+        Slot * slot;
+        for (;;) {
+            slot = &m_slots[tail & m_mask];
+            const auto sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<std::intptr_t>(sequence)
+                            - static_cast<std::intptr_t>(tail);
+            if (diff == 0) {
+                // Slot is free for this position, claim it
+                if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;   // slot still holds the value from one lap ago
+            } else {
+                tail = m_tail.load(std::memory_order_relaxed);  // another producer claimed it
+            }
+        }
+        slot->value = std::move(value);
+        slot->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Moves oldest value out of the queue. Returns false if queue is empty, or if
+    /// the producer that claimed the oldest position has not finished pushing yet.
+    /// Must only be called from the consumer thread.
+    bool            pop(value_type & value)
+    {
+        auto & slot = m_slots[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) { return false; }
+        value = std::move(slot.value);
+        slot.sequence.store(m_head + m_slots.size(), std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+private:
+    struct Slot final
+    {
+        std::atomic<size_type>  sequence;   ///< Position slot is free for, plus one once filled
+        value_type              value;
+    };
+
+    static size_type roundCapacity(size_type capacity)
+    {
+        size_type result = 1;
+        while (result < capacity) { result <<= 1; }
+        return result;
+    }
+
+private:
+    std::vector<Slot>       m_slots;        ///< Ring storage, size is a power of two
+    const size_type         m_mask;         ///< Maps a position to a slot index
+    size_type               m_head;         ///< Position of next value to pop, consumer only
+    char                    m_padding[64];  ///< Keeps head and tail on separate cache lines
+    std::atomic<size_type>  m_tail;         ///< Position of next value to push, claimed by producer
+};
+
+/****************************************************************************/
+
+} // namespace tools
+
+#endif
@@ -0,0 +1,111 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOOLS_SPSC_QUEUE_H_5B0E92D1
+#define TOOLS_SPSC_QUEUE_H_5B0E92D1
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace tools {
+
+/****************************************************************************/
+
+/** Bounded single-producer single-consumer queue
+ *
+ * A fixed-size ring buffer that one thread pushes into while another pops
+ * from it, without locking. All slots are created once, at construction, and
+ * values are moved in and out of them, so pushing and popping never allocate
+ * unless moving a value does.
+ *
+ * Exactly one thread may push, and exactly one thread may pop.
+ */
+template <typename T> class SPSCQueue final
+{
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+public:
+    /// Creates a queue holding at least capacity values
+    explicit        SPSCQueue(size_type capacity)
+                     : m_slots(roundCapacity(capacity)), m_mask(m_slots.size() - 1),
+                       m_head(0), m_tail(0) {}
+                    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue &     operator=(const SPSCQueue &) = delete;
+
+    size_type       capacity() const noexcept { return m_slots.size(); }
+
+    /// Moves a value into the queue. Returns false and leaves value alone if queue is full.
+    /// Must only be called from the producer thread.
+    bool            push(value_type && value)
+    {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == m_slots.size()) { return false; }
+        m_slots[tail & m_mask] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Moves oldest value out of the queue. Returns false if queue is empty.
+    /// Must only be called from the consumer thread.
+    bool            pop(value_type & value)
+    {
+        auto * slot = front();
+        if (slot == nullptr) { return false; }
+        value = std::move(*slot);
+        pop();
+        return true;
+    }
+
+    /// Returns oldest value in the queue, leaving it there, or nullptr if queue is empty.
+    /// Must only be called from the consumer thread.
+    value_type *    front()
+    {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) { return nullptr; }
+        return &m_slots[head & m_mask];
+    }
+
+    /// Releases oldest value's slot to the producer. Queue must not be empty.
+    /// Must only be called from the consumer thread.
+    void            pop()
+    {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    static size_type roundCapacity(size_type capacity)
+    {
+        size_type result = 1;
+        while (result < capacity) { result <<= 1; }
+        return result;
+    }
+
+private:
+    std::vector<value_type> m_slots;        ///< Ring storage, size is a power of two
+    const size_type m_mask;                 ///< Maps a position to a slot index
+    std::atomic<size_type> m_head;          ///< Position of next value to pop, written by consumer
+    char            m_padding[64];          ///< Keeps head and tail on separate cache lines
+    std::atomic<size_type> m_tail;          ///< Position of next value to push, written by producer
+};
+
+/****************************************************************************/
+
+} // namespace tools
+
+#endif
@@ -25,6 +25,7 @@
 
 #include <X11/Xlib.h>
 #undef Bool
+#include <sys/types.h>
 #include <functional>
 #include <memory>
 #include <stdexcept>
@@ -116,6 +117,7 @@ public:
     Display &               display() const { return m_display; }
     handle_type             handle() const { return m_device; }
     const std::string &     devNode() const { return m_devNode; }
+    dev_t                   devNum() const { return m_devNum; }
 
     void                    setEventMask(const std::vector<int> & events);
 
@@ -125,6 +127,7 @@ private:
     Display &               m_display;          ///< Display the device belongs to
     handle_type             m_device;           ///< Device handle
     std::string             m_devNode;          ///< Path to device node
+    dev_t                   m_devNum;           ///< Device number of m_devNode, 0 if unknown
 };
 
 /****************************************************************************/
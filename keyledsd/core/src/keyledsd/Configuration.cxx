@@ -19,8 +19,10 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cctype>
 #include <cerrno>
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
@@ -29,6 +31,7 @@
 #include <stdexcept>
 #include <system_error>
 #include <unistd.h>
+#include "keyledsd/utils.h"
 #include "tools/Paths.h"
 #include "tools/YAMLParser.h"
 #include "logging.h"
@@ -40,11 +43,83 @@ using keyleds::Configuration;
 
 struct Configuration::Profile::Lookup::Entry
 {
+    /// How the value is matched. All but Regex skip the regex engine.
+    enum class Kind { Any, Exact, Prefix, Suffix, Contains, Regex };
+
     std::string key;        ///< context entry key
     std::string value;      ///< string representation of the regex
     std::regex  regex;      ///< regex to match context entry value against
+    Kind        kind;       ///< matching strategy, computed from value
+    std::string literal;    ///< literal part of value, for Exact, Prefix, Suffix and Contains
+    unsigned    slot;       ///< index of key in lookup values, see Configuration::lookupValues
+
+    bool        matches(const std::string &) const;
 };
 
+/// Parses a yes/no flag. Returns false if value is neither.
+static bool parseFlag(const std::string & value, bool * result)
+{
+    if (value == "yes" || value == "true") { *result = true; return true; }
+    if (value == "no" || value == "false") { *result = false; return true; }
+    return false;
+}
+
+/// Splits a regex into optional .* wildcards around a literal string.
+/// Returns false if pattern has any other special character.
+static bool parseLiteralPattern(const std::string & pattern, bool * leading, bool * trailing,
+                                std::string * literal)
+{
+    static constexpr char wildcard[] = ".*";
+    static constexpr char special[] = ".[]{}()*+?|^$\\";
+
+    std::size_t begin = 0, end = pattern.size();
+    *leading = pattern.compare(0, 2, wildcard) == 0;
+    if (*leading) { begin += 2; }
+    *trailing = end >= begin + 2 && pattern.compare(end - 2, 2, wildcard) == 0
+                && (end < 3 || pattern[end - 3] != '\\');
+    if (*trailing) { end -= 2; }
+
+    literal->clear();
+    for (std::size_t idx = begin; idx < end; ++idx) {
+        char chr = pattern[idx];
+        if (chr == '\\') {
+            // Only escaped punctuation stands for itself, \d and friends are classes
+            if (++idx == end || std::isalnum(static_cast<unsigned char>(pattern[idx]))) {
+                return false;
+            }
+            chr = pattern[idx];
+        } else if (std::strchr(special, chr) != nullptr) {
+            return false;
+        }
+        literal->push_back(chr);
+    }
+    return true;
+}
+
+bool Configuration::Profile::Lookup::Entry::matches(const std::string & text) const
+{
+    // Wildcard . does not match line terminators, let the regex engine handle those
+    if (kind != Kind::Exact && kind != Kind::Regex && text.find_first_of("\r\n") != std::string::npos) {
+        return std::regex_match(text, regex);
+    }
+    switch (kind) {
+    case Kind::Any:
+        return true;
+    case Kind::Exact:
+        return text == literal;
+    case Kind::Prefix:
+        return text.compare(0, literal.size(), literal) == 0;
+    case Kind::Suffix:
+        return text.size() >= literal.size() &&
+               text.compare(text.size() - literal.size(), literal.size(), literal) == 0;
+    case Kind::Contains:
+        return text.find(literal) != std::string::npos;
+    case Kind::Regex:
+        break;
+    }
+    return std::regex_match(text, regex);
+}
+
 /****************************************************************************/
 /****************************************************************************/
 /** Builder class that creates a Configuration object from a YAML file.
@@ -84,6 +159,10 @@ public:
 public:
     Configuration::string_list          m_plugins;
     Configuration::path_list            m_pluginPaths;
+    unsigned                            m_renderThreads = 0;
+    bool                                m_measureLatency = false;
+    unsigned                            m_contextDebounce = Configuration::defaultContextDebounce;
+    bool                                m_preloadEffects = false;
     Configuration::device_map           m_devices;
     Configuration::key_group_list       m_keyGroups;
     Configuration::effect_group_list    m_effectGroups;
@@ -547,6 +626,26 @@ public:
                      const std::string & value, const std::string & anchor) override
     {
         if (key == "plugin-path")  { builder.m_pluginPaths = { value }; }
+        else if (key == "render-threads") {
+            if (!keyleds::parseNumber(value, &builder.m_renderThreads)) {
+                throw builder.makeError("render-threads must be a number");
+            }
+        }
+        else if (key == "context-debounce") {
+            if (!keyleds::parseNumber(value, &builder.m_contextDebounce)) {
+                throw builder.makeError("context-debounce must be a number");
+            }
+        }
+        else if (key == "measure-latency") {
+            if (!parseFlag(value, &builder.m_measureLatency)) {
+                throw builder.makeError("measure-latency must be yes or no");
+            }
+        }
+        else if (key == "preload-effects") {
+            if (!parseFlag(value, &builder.m_preloadEffects)) {
+                throw builder.makeError("preload-effects must be yes or no");
+            }
+        }
         else MappingBuildState::scalarEntry(builder, key, value, anchor);
     }
 
@@ -667,9 +766,15 @@ ConfigurationBuilder::ParseError ConfigurationBuilder::makeError(const std::stri
 
 /****************************************************************************/
 
+constexpr unsigned Configuration::defaultContextDebounce;
+
 Configuration::Configuration(std::string path,
                              string_list plugins,
                              path_list pluginPaths,
+                             unsigned renderThreads,
+                             bool measureLatency,
+                             unsigned contextDebounce,
+                             bool preloadEffects,
                              device_map devices,
                              key_group_list keyGroups,
                              effect_group_list effectGroups,
@@ -677,14 +782,32 @@ Configuration::Configuration(std::string path,
  : m_path(std::move(path)),
    m_plugins(std::move(plugins)),
    m_pluginPaths(std::move(pluginPaths)),
+   m_renderThreads(renderThreads),
+   m_measureLatency(measureLatency),
+   m_contextDebounce(contextDebounce),
+   m_preloadEffects(preloadEffects),
    m_devices(std::move(devices)),
    m_keyGroups(std::move(keyGroups)),
    m_effectGroups(std::move(effectGroups)),
    m_profiles(std::move(profiles))
-{}
+{
+    for (auto & profile : m_profiles) { profile.m_lookup.bindKeys(m_lookupKeys); }
+}
 
 Configuration::~Configuration() {}
 
+Configuration::lookup_values Configuration::lookupValues(const string_map & context) const
+{
+    lookup_values result(m_lookupKeys.size(), nullptr);
+    for (const auto & entry : context) {
+        auto it = m_lookupKeys.find(entry.first);
+        if (it != m_lookupKeys.end() && result[it->second] == nullptr) {
+            result[it->second] = &entry.second;     // first occurrence wins, as in Lookup::match
+        }
+    }
+    return result;
+}
+
 std::unique_ptr<Configuration> Configuration::loadFile(const std::string & path)
 {
     using tools::paths::XDG;
@@ -706,6 +829,10 @@ std::unique_ptr<Configuration> Configuration::loadFile(const std::string & path)
         actualPath,
         std::move(builder.m_plugins),
         std::move(builder.m_pluginPaths),
+        builder.m_renderThreads,
+        builder.m_measureLatency,
+        builder.m_contextDebounce,
+        builder.m_preloadEffects,
         std::move(builder.m_devices),
         std::move(builder.m_keyGroups),
         std::move(builder.m_effectGroups),
@@ -725,6 +852,11 @@ Configuration::EffectGroup::EffectGroup(std::string name,
 
 Configuration::EffectGroup::~EffectGroup() {}
 
+bool Configuration::EffectGroup::operator==(const EffectGroup & other) const
+{
+    return m_name == other.m_name && m_keyGroups == other.m_keyGroups && m_effects == other.m_effects;
+}
+
 /****************************************************************************/
 
 Configuration::KeyGroup::KeyGroup(std::string name, key_list keys)
@@ -734,6 +866,11 @@ Configuration::KeyGroup::KeyGroup(std::string name, key_list keys)
 
 Configuration::KeyGroup::~KeyGroup() {}
 
+bool Configuration::KeyGroup::operator==(const KeyGroup & other) const
+{
+    return m_name == other.m_name && m_keys == other.m_keys;
+}
+
 /****************************************************************************/
 
 Configuration::Profile::Profile(std::string name,
@@ -766,11 +903,28 @@ bool Configuration::Profile::Lookup::match(const string_map & context) const
                 context.begin(), context.end(),
                 [&entry](const auto & ctxEntry) { return ctxEntry.first == entry.key; }
             );
-            const auto & value = it != context.end() ? it->second : std::string();
-            return std::regex_match(value, entry.regex);
+            return entry.matches(it != context.end() ? it->second : std::string());
+    });
+}
+
+bool Configuration::Profile::Lookup::match(const lookup_values & values) const
+{
+    static const std::string empty;
+    return std::all_of(
+        m_entries.cbegin(), m_entries.cend(),
+        [&values](const auto & entry) {
+            const auto * value = values[entry.slot];
+            return entry.matches(value != nullptr ? *value : empty);
     });
 }
 
+void Configuration::Profile::Lookup::bindKeys(std::unordered_map<std::string, unsigned> & keys)
+{
+    for (auto & entry : m_entries) {
+        entry.slot = keys.emplace(entry.key, keys.size()).first->second;
+    }
+}
+
 Configuration::Profile::Lookup::entry_list
 Configuration::Profile::Lookup::buildRegexps(string_map filters)
 {
@@ -778,12 +932,27 @@ Configuration::Profile::Lookup::buildRegexps(string_map filters)
     result.reserve(filters.size());
     std::transform(filters.begin(), filters.end(), std::back_inserter(result),
                    [](auto & entry) {
+                       // Regex is always built, to validate it and to handle line terminators
                        auto regex = std::regex(entry.second,
                                                std::regex::nosubs | std::regex::optimize);
+
+                       bool leading, trailing;
+                       std::string literal;
+                       auto kind = Entry::Kind::Regex;
+                       if (parseLiteralPattern(entry.second, &leading, &trailing, &literal)) {
+                           kind = literal.empty() && (leading || trailing) ? Entry::Kind::Any
+                                : leading && trailing ? Entry::Kind::Contains
+                                : leading ? Entry::Kind::Suffix
+                                : trailing ? Entry::Kind::Prefix
+                                : Entry::Kind::Exact;
+                       }
                        return Entry{
                            std::move(entry.first),
                            std::move(entry.second),
-                           std::move(regex)
+                           std::move(regex),
+                           kind,
+                           std::move(literal),
+                           0
                        };
                    });
     return result;
@@ -796,3 +965,8 @@ Configuration::Effect::Effect(std::string name, string_map items)
 {}
 
 Configuration::Effect::~Effect() {}
+
+bool Configuration::Effect::operator==(const Effect & other) const
+{
+    return m_name == other.m_name && m_items == other.m_items;
+}
@@ -0,0 +1,100 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "keyledsd/LatencyStats.h"
+
+#include <algorithm>
+
+using keyleds::LatencyStats;
+
+static constexpr unsigned long firstBucketLimit = 250;     // microseconds
+
+/****************************************************************************/
+
+constexpr unsigned LatencyStats::bucketCount;
+
+LatencyStats::LatencyStats()
+{
+    reset();
+}
+
+LatencyStats::duration LatencyStats::bucketLimit(unsigned idx)
+{
+    if (idx + 1 >= bucketCount) { return duration::max(); }
+    return duration(firstBucketLimit << idx);
+}
+
+void LatencyStats::record(duration value)
+{
+    const auto micros = static_cast<unsigned long>(std::max(value.count(), duration::rep(0)));
+
+    unsigned idx = 0;
+    while (idx + 1 < bucketCount && micros >= (firstBucketLimit << idx)) { ++idx; }
+    m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+
+    m_total.fetch_add(micros, std::memory_order_relaxed);
+    if (micros > m_max.load(std::memory_order_relaxed)) {
+        m_max.store(micros, std::memory_order_relaxed);     // single writer
+    }
+    m_count.fetch_add(1, std::memory_order_release);
+}
+
+void LatencyStats::expire()
+{
+    m_expired.fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyStats::Summary LatencyStats::summary() const
+{
+    Summary result;
+    result.count = m_count.load(std::memory_order_acquire);
+    for (unsigned idx = 0; idx < bucketCount; ++idx) {
+        result.buckets[idx] = m_buckets[idx].load(std::memory_order_relaxed);
+    }
+    result.expired = m_expired.load(std::memory_order_relaxed);
+    result.total = duration(m_total.load(std::memory_order_relaxed));
+    result.max = duration(m_max.load(std::memory_order_relaxed));
+    return result;
+}
+
+void LatencyStats::reset()
+{
+    for (auto & bucket : m_buckets) { bucket.store(0, std::memory_order_relaxed); }
+    m_count.store(0, std::memory_order_relaxed);
+    m_expired.store(0, std::memory_order_relaxed);
+    m_total.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+/****************************************************************************/
+
+LatencyStats::duration LatencyStats::Summary::mean() const
+{
+    return count > 0 ? duration(total.count() / static_cast<duration::rep>(count)) : duration::zero();
+}
+
+LatencyStats::duration LatencyStats::Summary::percentile(unsigned pct) const
+{
+    const unsigned long target = (count * pct + 99) / 100;
+    unsigned long seen = 0;
+    for (unsigned idx = 0; idx < bucketCount; ++idx) {
+        seen += buckets[idx];
+        if (seen >= target && seen > 0) {
+            return std::min(bucketLimit(idx), max);
+        }
+    }
+    return max;
+}
@@ -33,11 +33,31 @@ using keyleds::RenderLoop;
 
 /****************************************************************************/
 
+constexpr std::size_t RenderLoop::eventQueueSize;
+constexpr std::size_t RenderLoop::maxPendingKeys;
+constexpr std::chrono::seconds RenderLoop::latencyTimeout;
+constexpr unsigned long RenderLoop::latencyLogInterval;
+
 RenderLoop::RenderLoop(Device & device, unsigned fps)
     : AnimationLoop(fps),
       m_device(device),
+      m_renderers(std::make_shared<const Snapshot>(Snapshot{0, {}, nullptr, nullptr})),
+      m_generation(0),
+      m_renderedGeneration(0),
+      m_events(eventQueueSize),
+      m_inputEvents(eventQueueSize),
+      m_droppedEvents(0),
+      m_measureLatency(false),
+      m_latencyLogged(0),
       m_state(renderTargetFor(device)),
-      m_buffer(renderTargetFor(device))
+      m_buffer(renderTargetFor(device)),
+      m_renderThreads(0),
+      m_frame(0),
+      m_busyWorkers(0),
+      m_stopWorkers(false),
+      m_layerRenderers(nullptr),
+      m_layerTime(0),
+      m_nextLayer(0)
 {
     // Ensure no allocation happens in render()
     std::size_t max = 0;
@@ -45,17 +65,198 @@ RenderLoop::RenderLoop(Device & device, unsigned fps)
         max = std::max(max, block.keys().size());
     }
     m_directives.reserve(max);
+    m_pendingKeys.reserve(maxPendingKeys);
 }
 
 RenderLoop::~RenderLoop()
-{}
+{
+    resizeWorkers(0);       // render thread is stopped, workers are ours
+}
+
+/** Publish a new renderer list.
+ * The list is picked up by the render thread at the start of next frame.
+ * @param renderers List of renderers to run, in order.
+ * @param prepare Function to invoke on render thread before list is first used.
+ * @param handleEvent Function to invoke on render thread for every input event.
+ */
+void RenderLoop::setRenderers(renderer_list renderers, prepare_function prepare,
+                              event_function handleEvent)
+{
+    auto snapshot = std::make_shared<const Snapshot>(Snapshot{
+        ++m_generation, std::move(renderers), std::move(prepare), std::move(handleEvent)
+    });
+    std::atomic_store(&m_renderers, snapshot_ptr(std::move(snapshot)));
+}
+
+/** Publish an empty renderer list and wait for previous ones to be released.
+ * The render thread holds a reference to the snapshot it uses for the duration
+ * of a frame, so this waits at most one frame.
+ */
+void RenderLoop::clearRenderers()
+{
+    auto empty = std::make_shared<const Snapshot>(Snapshot{++m_generation, {}, nullptr, nullptr});
+    std::weak_ptr<const Snapshot> previous = std::atomic_exchange(&m_renderers,
+                                                                  snapshot_ptr(std::move(empty)));
+    std::unique_lock<std::mutex> lock(m_mReleased);
+    m_cReleased.wait(lock, [&previous] { return previous.expired(); });
+}
+
+/** Set worker thread count.
+ * The render thread replaces the worker pool at the start of next frame.
+ * @param count Number of worker threads. Zero disables concurrent rendering.
+ */
+void RenderLoop::setRenderThreads(unsigned count)
+{
+    m_renderThreads = count;
+}
+
+/** Replace worker threads.
+ * Only invoked between frames, by the render thread, or once it is stopped.
+ * @param count Number of worker threads to start.
+ */
+void RenderLoop::resizeWorkers(unsigned count)
+{
+    if (count == m_workers.size()) { return; }
+    {
+        std::lock_guard<std::mutex> workerLock(m_mWorkers);
+        m_stopWorkers = true;
+    }
+    m_cWorkers.notify_all();
+    for (auto & worker : m_workers) { worker.join(); }
+    m_workers.clear();
+    m_stopWorkers = false;
+
+    {
+        // Workers must start from current frame, or they would miss the next one
+        std::lock_guard<std::mutex> workerLock(m_mWorkers);
+        m_workers.reserve(count);
+        for (unsigned idx = 0; idx < count; ++idx) {
+            m_workers.emplace_back(&RenderLoop::workerEntry, this, m_frame);
+        }
+    }
+    DEBUG("using ", count, " render threads for loop ", this);
+}
+
+/** Queue a key event.
+ * @param key Key that was pressed or released.
+ * @param press Whether the key was pressed.
+ * @param time When the event happened.
+ * @return `true` if event was queued, `false` if it was dropped.
+ */
+bool RenderLoop::postKeyEvent(const KeyDatabase::Key & key, bool press, Event::clock::time_point time)
+{
+    return postEvent(m_events, Event{Event::Type::Key, time, &key, press, {}});
+}
+
+/** Queue a generic event.
+ * @param values Event values, passed on as is.
+ * @return `true` if event was queued, `false` if it was dropped.
+ */
+bool RenderLoop::postGenericEvent(string_map values)
+{
+    return postEvent(m_events, Event{Event::Type::Generic, Event::clock::now(), nullptr, false,
+                                     std::move(values)});
+}
+
+/** Queue a key event from the input reader thread.
+ * @param key Key that was pressed or released.
+ * @param press Whether the key was pressed.
+ * @param time When the event happened.
+ * @return `true` if event was queued, `false` if it was dropped.
+ */
+bool RenderLoop::postInputKeyEvent(const KeyDatabase::Key & key, bool press,
+                                   Event::clock::time_point time)
+{
+    return postEvent(m_inputEvents, Event{Event::Type::Key, time, &key, press, {}});
+}
+
+bool RenderLoop::postEvent(tools::SPSCQueue<Event> & queue, Event && event)
+{
+    if (!queue.push(std::move(event))) {
+        m_droppedEvents.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+/** Deliver queued events.
+ * Invoked by the render thread at the start of every frame. Both queues are
+ * merged in timestamp order.
+ * @param handleEvent Function to pass events to. Events are dropped if it is empty.
+ */
+void RenderLoop::dispatchEvents(const event_function & handleEvent)
+{
+    for (;;) {
+        auto * event = m_events.front();
+        auto * inputEvent = m_inputEvents.front();
+        if (event == nullptr && inputEvent == nullptr) { break; }
+
+        auto & queue = inputEvent != nullptr && (event == nullptr || inputEvent->time < event->time)
+                     ? m_inputEvents : m_events;
+        auto & next = *queue.front();
+        if (handleEvent) { handleEvent(next); }
+        if (next.type == Event::Type::Key && next.press &&
+            m_measureLatency.load(std::memory_order_relaxed)) {
+            if (m_pendingKeys.size() == maxPendingKeys) {
+                m_pendingKeys.erase(m_pendingKeys.begin());
+                m_latency.expire();
+            }
+            m_pendingKeys.push_back({next.key->index, next.time});
+        }
+        next.values.clear();    // don't keep event data around until slot is reused
+        queue.pop();
+    }
+
+    auto dropped = m_droppedEvents.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        WARNING("dropped ", dropped, " events on loop ", this, ": queue full");
+    }
+}
 
-/** Lock render loop, to synchronize renderer list access.
- * @return Mutex lock preventing the animation from using renderers until it is destroyed.
+/** Enable or disable latency measurement.
+ * @param value Whether key presses should be tracked from now on.
  */
-std::unique_lock<std::mutex> RenderLoop::lock()
+void RenderLoop::setMeasureLatency(bool value)
 {
-    return std::unique_lock<std::mutex>(m_mRenderers);
+    m_measureLatency = value;
+}
+
+/** Update latency statistics.
+ * Invoked by the render thread before committing a frame, while m_state still holds
+ * the previous frame. Pending keys whose color changed in this frame are recorded.
+ * @param committed Whether the frame is actually sent to the device.
+ */
+void RenderLoop::updateLatency(bool committed)
+{
+    const auto now = Event::clock::now();
+    auto end = std::remove_if(
+        m_pendingKeys.begin(), m_pendingKeys.end(),
+        [this, now, committed](const auto & pending) {
+            if (committed && m_state[pending.index] != m_buffer[pending.index]) {
+                m_latency.record(std::chrono::duration_cast<LatencyStats::duration>(
+                    now - pending.time
+                ));
+                return true;
+            }
+            if (now - pending.time > latencyTimeout) {
+                m_latency.expire();
+                return true;
+            }
+            return false;
+        });
+    m_pendingKeys.erase(end, m_pendingKeys.end());
+
+    const auto summary = m_latency.summary();
+    if (summary.count < m_latencyLogged) { m_latencyLogged = 0; }   // was reset
+    if (summary.count >= m_latencyLogged + latencyLogInterval) {
+        m_latencyLogged = summary.count;
+        INFO("key latency on ", m_device.path(), ": ", summary.count, " samples",
+             ", mean ", summary.mean().count(), "us",
+             ", p50 ", summary.percentile(50).count(), "us",
+             ", p99 ", summary.percentile(99).count(), "us",
+             ", max ", summary.max.count(), "us",
+             ", ", summary.expired, " without change");
+    }
 }
 
 /** Create render target for a device.
@@ -77,17 +278,57 @@ keyleds::RenderTarget RenderLoop::renderTargetFor(const Device & device)
  */
 bool RenderLoop::render(unsigned long nanosec)
 {
+    const auto renderThreads = m_renderThreads.load();
+    if (renderThreads != m_workers.size()) { resizeWorkers(renderThreads); }
+
+    // Holding the snapshot keeps it alive until the frame is done
+    auto snapshot = std::atomic_load(&m_renderers);
+    try {
+        renderFrame(*snapshot, nanosec);
+    } catch (...) {
+        releaseSnapshot(snapshot);
+        throw;
+    }
+    releaseSnapshot(snapshot);
+    return true;
+}
+
+/** Render one frame and send it to the device.
+ * @param snapshot Renderer list to use.
+ * @param nanosec Time since last invocation.
+ */
+void RenderLoop::renderFrame(const Snapshot & snapshot, unsigned long nanosec)
+{
+    const auto & renderers = snapshot.renderers;
+
     // Run all renderers
-    bool hasRenderers;
-    {
-        std::lock_guard<std::mutex> lock(m_mRenderers);
-        hasRenderers = !m_renderers.empty();
-        for (const auto & effect : m_renderers) {
+    if (snapshot.generation != m_renderedGeneration) {
+        m_renderedGeneration = snapshot.generation;
+        if (snapshot.prepare) { snapshot.prepare(); }
+        // Size layer results once per renderer list, not on every frame
+        m_layers.resize(renderers.size());
+        m_layerFailed.resize(renderers.size());
+    }
+    dispatchEvents(snapshot.handleEvent);
+
+    if (m_workers.empty()) {
+        for (const auto & effect : renderers) {
             effect->render(nanosec, m_buffer);
         }
+    } else {
+        // Render independent layers concurrently, then compose them in order
+        renderLayers(renderers, nanosec);
+        for (std::size_t idx = 0; idx < renderers.size(); ++idx) {
+            if (m_layerFailed[idx]) { continue; }   // do not step it twice this frame
+            if (m_layers[idx]) {
+                blend(m_buffer, *m_layers[idx]);
+            } else {
+                renderers[idx]->render(nanosec, m_buffer);
+            }
+        }
     }
 
-    if (hasRenderers) {
+    if (!renderers.empty()) {
         m_device.flush();   // Ensure another program using the device did not fill
                             // The inbound report queue.
 
@@ -120,12 +361,106 @@ bool RenderLoop::render(unsigned long nanosec)
 
         // Commit color changes, if any
         if (hasChanges) { m_device.commitColors(); }
+        if (!m_pendingKeys.empty()) { updateLatency(hasChanges); }
 
         using std::swap;
         swap(m_state, m_buffer);
+
+        // Frame is out, let renderers use the time left until next one
+        for (const auto & effect : renderers) { effect->frameDone(); }
     }
+}
 
-    return true;
+/** Release render thread's snapshot reference.
+ * Wakes up clearRenderers, which waits for the snapshot it replaced to expire.
+ * @param snapshot Reference to drop.
+ */
+void RenderLoop::releaseSnapshot(snapshot_ptr & snapshot)
+{
+    snapshot.reset();
+    { std::lock_guard<std::mutex> lock(m_mReleased); }  // waiter is either sleeping or yet to check
+    m_cReleased.notify_all();
+}
+
+/** Render independent layers.
+ * Wakes up worker threads and has them call renderLayer on all renderers,
+ * taking part in the work, then waits until all workers are done.
+ * Results are stored into m_layers, in renderer order. Renderers that threw
+ * are flagged in m_layerFailed. Workers are always done when this returns,
+ * even if it throws.
+ * @param renderers Renderers of current frame.
+ * @param nanosec Time since last invocation.
+ */
+void RenderLoop::renderLayers(const renderer_list & renderers, unsigned long nanosec)
+{
+    assert(m_layers.size() == renderers.size());
+    std::fill(m_layers.begin(), m_layers.end(), nullptr);
+    std::fill(m_layerFailed.begin(), m_layerFailed.end(), false);
+    m_layerRenderers = &renderers;
+    m_layerTime = nanosec;
+    m_nextLayer = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mWorkers);
+        m_busyWorkers = m_workers.size();
+        ++m_frame;
+    }
+    m_cWorkers.notify_all();
+
+    // Workers use the snapshot and m_layers, they must be done before we leave
+    auto waitWorkers = [this] {
+        std::unique_lock<std::mutex> lock(m_mWorkers);
+        m_cWorkersDone.wait(lock, [this] { return m_busyWorkers == 0; });
+    };
+    try {
+        runLayerJobs();
+    } catch (...) {
+        waitWorkers();
+        throw;
+    }
+    waitWorkers();
+}
+
+/** Render layers until none is left.
+ * Shared by the render thread and the workers, which pick renderers in turn.
+ * If a renderer throws, it is flagged as failed and the exception is passed on.
+ */
+void RenderLoop::runLayerJobs()
+{
+    const auto & renderers = *m_layerRenderers;
+    for (unsigned idx = m_nextLayer++; idx < renderers.size(); idx = m_nextLayer++) {
+        try {
+            m_layers[idx] = renderers[idx]->renderLayer(m_layerTime);
+        } catch (...) {
+            m_layerFailed[idx] = true;
+            throw;
+        }
+    }
+}
+
+/** Worker thread loop.
+ * Waits for a new frame, runs layer jobs and signals completion until stopped.
+ * @param frame Frame counter value when the worker was created.
+ */
+void RenderLoop::workerEntry(unsigned long frame)
+{
+    std::unique_lock<std::mutex> lock(m_mWorkers);
+    for (;;) {
+        m_cWorkers.wait(lock, [this, &frame] { return m_stopWorkers || m_frame != frame; });
+        if (m_stopWorkers) { return; }
+        frame = m_frame;
+
+        lock.unlock();
+        try {
+            runLayerJobs();
+        } catch (std::exception & error) {
+            ERROR("render worker: ", error.what());
+        } catch (...) {
+            ERROR("render worker: unknown error");
+        }
+        lock.lock();
+
+        if (--m_busyWorkers == 0) { m_cWorkersDone.notify_one(); }
+    }
 }
 
 /** Main render loop loop.
@@ -14,9 +14,11 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <pthread.h>
 #include <unistd.h>
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <sstream>
 #include <stdexcept>
 #include "logging.h"
@@ -60,6 +62,14 @@ void Configuration::setPolicy(const std::string & name, const Policy * policy)
     }
 }
 
+void Configuration::releasePolicy(const Policy * policy)
+{
+    if (m_globalPolicy.load() == policy) { setPolicy(nullptr); }
+    for (auto & logger : m_loggers) {
+        if (logger->policy() == policy) { logger->setPolicy(nullptr); }
+    }
+}
+
 const Policy & Configuration::defaultPolicy()
 {
     static const auto policy = logging::FilePolicy(STDERR_FILENO, info::value);
@@ -106,6 +116,12 @@ logging::FilePolicy::~FilePolicy()
 void logging::FilePolicy::write(level_t level, const std::string & name, const std::string & msg) const
 {
     if (level > m_minLevel) { return; }
+    writeData(format(level, name, msg));
+}
+
+std::string logging::FilePolicy::format(level_t level, const std::string & name,
+                                        const std::string & msg) const
+{
     std::ostringstream buffer;
     if (m_tty) {
         buffer <<levels.at(level)
@@ -114,9 +130,11 @@ void logging::FilePolicy::write(level_t level, const std::string & name, const s
     } else {
         buffer <<'<' <<level <<'>' <<name <<": " <<msg <<'\n';
     }
+    return buffer.str();
+}
 
-    const auto & data = buffer.str();
-
+void logging::FilePolicy::writeData(const std::string & data) const
+{
     std::size_t todo = data.size();
     std::size_t done = 0;
 
@@ -130,6 +148,78 @@ void logging::FilePolicy::write(level_t level, const std::string & name, const s
 
 /****************************************************************************/
 
+static constexpr auto flushInterval = std::chrono::milliseconds(100);  // longest writer sleep
+
+// Forked processes do not have the writer thread, async policies write directly there
+static bool isForkedProcess = false;
+static void markForkedProcess() { isForkedProcess = true; }
+
+logging::AsyncFilePolicy::AsyncFilePolicy(int fd, level_t minLevel, std::size_t capacity,
+                                          bool ownsFd)
+ : FilePolicy(fd, minLevel, ownsFd),
+   m_queue(capacity),
+   m_dropped(0),
+   m_stop(false),
+   m_thread(&AsyncFilePolicy::run, this)
+{
+    static std::once_flag registered;
+    std::call_once(registered, []() { pthread_atfork(nullptr, nullptr, markForkedProcess); });
+}
+
+logging::AsyncFilePolicy::~AsyncFilePolicy()
+{
+    Configuration::instance().releasePolicy(this);
+    m_stop.store(true, std::memory_order_release);
+    m_wakeup.notify_one();
+    m_thread.join();
+}
+
+void logging::AsyncFilePolicy::write(level_t level, const std::string & name,
+                                     const std::string & msg) const
+{
+    if (level > m_minLevel) { return; }
+    if (isForkedProcess) {
+        FilePolicy::write(level, name, msg);
+        return;
+    }
+    if (!m_queue.push(format(level, name, msg))) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    m_wakeup.notify_one();     // cheap when writer is not sleeping
+}
+
+void logging::AsyncFilePolicy::run()
+{
+    std::string batch, entry;
+    unsigned long reported = 0;     // dropped entries already warned about
+
+    for (;;) {
+        const bool stopping = m_stop.load(std::memory_order_acquire);
+
+        batch.clear();
+        while (m_queue.pop(entry)) { batch += entry; }
+
+        const auto dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped != reported) {
+            batch += format(warning::value, "logging", std::to_string(dropped - reported) +
+                            " entries dropped, queue was full");
+            reported = dropped;
+        }
+        if (!batch.empty()) {
+            writeData(batch);
+            continue;           // more entries may have arrived during the write
+        }
+        if (stopping) { return; }
+
+        // Loggers notify without locking, so a wakeup can be missed: bound the wait
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wakeup.wait_for(lock, flushInterval);
+    }
+}
+
+/****************************************************************************/
+
 Logger::Logger(std::string name, const Policy * policy)
  : m_name(std::move(name)),
    m_policy(policy)
@@ -20,6 +20,7 @@
 #include <X11/Xatom.h>
 #include <X11/extensions/XInput2.h>
 #undef Bool
+#include <sys/stat.h>
 #include <algorithm>
 #include <cassert>
 #include <cstddef>
@@ -230,16 +231,22 @@ void xlib::Window::loadClass() const
 constexpr Device::handle_type Device::invalid_device;
 
 Device::Device(Display & display, handle_type device)
- : m_display(display), m_device(device)
+ : m_display(display), m_device(device), m_devNum(0)
 {
     m_devNode = getProperty(m_display.atom(deviceNodeAtom), XA_STRING);
+
+    struct stat info;
+    if (!m_devNode.empty() && stat(m_devNode.c_str(), &info) == 0 && S_ISCHR(info.st_mode)) {
+        m_devNum = info.st_rdev;
+    }
 }
 
 Device::Device(Device && other) noexcept
- : m_display(other.m_display), m_device(invalid_device)
+ : m_display(other.m_display), m_device(invalid_device), m_devNum(0)
 {
     std::swap(m_device, other.m_device);
     std::swap(m_devNode, other.m_devNode);
+    std::swap(m_devNum, other.m_devNum);
 }
 
 Device & Device::operator=(Device && other)
@@ -248,6 +255,7 @@ Device & Device::operator=(Device && other)
     if (m_device != invalid_device) { setEventMask({}); m_device = invalid_device; }
     std::swap(m_device, other.m_device);
     m_devNode = std::move(other.m_devNode);
+    m_devNum = other.m_devNum;
     return *this;
 }
 
@@ -29,6 +29,6 @@ function stars(kb)
     end
 end
 
-buffer = RenderTarget:new()
-thread(stars, buffer)
-function render(ms, target) target:blend(buffer) end
+-- Exposing our buffer as layer lets keyleds blend it onto the keyboard itself
+layer = RenderTarget:new()
+thread(stars, layer)
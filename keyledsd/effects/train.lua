@@ -28,9 +28,8 @@ function train(buffer, color, delay)
     end
 end
 
-buffer = RenderTarget:new()
-thread(train, buffer, tocolor(0, 1, 0, 1), 0)
-thread(train, buffer, tocolor(1, 0, 0, 1), 3)
-thread(train, buffer, tocolor(0, 0, 1, 1), 6)
-
-function render(ms, target) target:blend(buffer) end
+-- Exposing our buffer as layer lets keyleds blend it onto the keyboard itself
+layer = RenderTarget:new()
+thread(train, layer, tocolor(0, 1, 0, 1), 0)
+thread(train, layer, tocolor(1, 0, 0, 1), 3)
+thread(train, layer, tocolor(0, 0, 1, 1), 6)
@@ -0,0 +1,82 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEYLEDS_PLUGINS_LUA_ALLOCATOR_H_2A6E94F0
+#define KEYLEDS_PLUGINS_LUA_ALLOCATOR_H_2A6E94F0
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace keyleds { namespace plugin { namespace lua {
+
+/****************************************************************************/
+
+/** Memory allocator for LUA states
+ *
+ * Small blocks are carved out of arenas, one free list per size class. As LUA
+ * always tells the size of the block it frees, blocks carry no header. Larger
+ * blocks go straight to the system allocator. Arenas are only released when
+ * the allocator is destroyed, so it must outlive all states using it.
+ *
+ * Growing allocations fail once the limit is reached, which LUA reports as an
+ * out of memory error. Not thread-safe: all states using it must run on the
+ * same thread.
+ */
+class Allocator final
+{
+    static constexpr std::size_t granularity = 16;      ///< Size class step, also alignment
+    static constexpr std::size_t classCount = 16;       ///< Blocks up to 256 bytes are pooled
+    static constexpr std::size_t maxPooledSize = granularity * classCount;
+    static constexpr std::size_t arenaSize = 16384;     ///< Bytes requested from system at once
+public:
+    explicit        Allocator(std::size_t limit = 0);
+                    Allocator(const Allocator &) = delete;
+                    ~Allocator();
+
+    /// Bytes currently allocated to LUA
+    std::size_t     used() const noexcept { return m_used; }
+    /// Bytes LUA may allocate, 0 for no limit
+    std::size_t     limit() const noexcept { return m_limit; }
+    void            setLimit(std::size_t limit) noexcept { m_limit = limit; }
+
+    /// lua_Alloc-compatible entry point, ud must point to an Allocator
+    static void *   allocate(void * ud, void * ptr, std::size_t osize, std::size_t nsize);
+
+private:
+    struct Block { Block * next; };
+
+    static std::size_t sizeClass(std::size_t size) { return (size - 1) / granularity; }
+
+    void *          reallocate(void * ptr, std::size_t osize, std::size_t nsize);
+    void *          take(std::size_t cls);
+    void            give(void * ptr, std::size_t cls);
+
+private:
+    std::size_t     m_limit;        ///< Maximum bytes in use, 0 for no limit
+    std::size_t     m_used;         ///< Bytes currently in use, as requested by LUA
+    std::array<Block *, classCount> m_free;     ///< Free list heads, by size class
+    char *          m_arenaNext;    ///< Next free byte in current arena
+    char *          m_arenaEnd;     ///< End of current arena
+    std::vector<std::unique_ptr<char[]>> m_arenas;  ///< All arenas, for releasing
+};
+
+/****************************************************************************/
+
+} } } // namespace keyleds::plugin::lua
+
+#endif
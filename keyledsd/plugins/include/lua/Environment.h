@@ -18,6 +18,7 @@
 #define KEYLEDS_PLUGINS_LUA_LUA_KEYLEDS_H_3EAF7EA0
 
 #include <string>
+#include <vector>
 #include "lua/lua_Interpolator.h"
 #include "lua/lua_Key.h"
 #include "lua/lua_KeyDatabase.h"
@@ -43,7 +44,9 @@ public:
     class Controller
     {
     protected:
+        using InterpolatorStore = keyleds::lua::InterpolatorStore;
         using Thread = keyleds::lua::Thread;
+        using index_list = std::vector<unsigned>;
     public:
         virtual void            print(const std::string &) const = 0;
         virtual bool            parseColor(const std::string &, RGBAColor *) const = 0;
@@ -53,6 +56,13 @@ public:
 
         virtual int             createThread(lua_State * lua, int nargs) = 0;
         virtual void            destroyThread(lua_State * lua, Thread &) = 0;
+        virtual void            pauseThread(Thread &) = 0;
+        virtual void            resumeThread(Thread &) = 0;
+
+        virtual InterpolatorStore & interpolators() = 0;
+
+        /// Key indices of a group exposed to the script, sorted, or null if unknown
+        virtual const index_list * keyGroupIndices(const KeyDatabase::KeyGroup *) const = 0;
     protected:
         ~Controller() {}
     };
@@ -63,8 +73,6 @@ public:
     void            openKeyleds(Controller *);
     Controller *    controller() const;
 
-    void            stepInterpolators(unsigned ms) { Interpolator::stepAll(m_lua, ms); }
-
     static const void * const waitToken;
 private:
     lua_State *     m_lua;
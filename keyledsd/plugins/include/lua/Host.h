@@ -0,0 +1,114 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEYLEDS_PLUGINS_LUA_HOST_H_9C0B7E15
+#define KEYLEDS_PLUGINS_LUA_HOST_H_9C0B7E15
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "keyledsd/effect/interfaces.h"
+#include "lua/Allocator.h"
+#include "lua/Environment.h"
+
+struct lua_State;
+
+namespace std {
+    template <> struct default_delete<lua_State> { void operator()(lua_State *) const; };
+}
+
+
+namespace keyleds { namespace plugin { namespace lua {
+
+/****************************************************************************/
+
+/** LUA virtual machine hosting one or more effects
+ *
+ * Holds a LUA state with libraries and keyleds environment loaded, in which
+ * effects run their scripts, each in an environment of its own. The host is
+ * the controller of the LUA environment. It forwards requests from scripts to
+ * the effect it was entered for, except for render target destruction, which
+ * goes to the effect that created the target, as the garbage collector may
+ * destroy targets while another effect runs.
+ *
+ * Effects must enter the host before using its state. Entering locks it, so
+ * effects sharing a host may be invoked from several threads.
+ */
+class Host final : public keyleds::lua::Environment::Controller
+{
+    using EffectService = keyleds::effect::interface::EffectService;
+    using Controller = keyleds::lua::Environment::Controller;
+    using RenderTarget = keyleds::RenderTarget;
+    using RGBAColor = keyleds::RGBAColor;
+    using state_ptr = std::unique_ptr<lua_State>;
+public:
+    /// Scope during which an effect has exclusive use of the host. Entries nest.
+    class Entry final
+    {
+    public:
+                        Entry(Host &, Controller &);
+                        Entry(const Entry &) = delete;
+                        ~Entry();
+    private:
+        Host &          m_host;
+        std::lock_guard<std::recursive_mutex> m_lock;
+        Controller *    m_previous;     ///< Controller to restore when leaving
+    };
+
+public:
+    /// Creates a host configured after the service's effect configuration
+    static std::shared_ptr<Host> create(EffectService &);
+
+                    Host(std::size_t memoryLimit);
+                    Host(const Host &) = delete;
+                    ~Host();
+
+    lua_State *     state() const { return m_state.get(); }
+    std::size_t     memoryUsed() const { return m_allocator.used(); }
+    std::size_t     memoryLimit() const { return m_allocator.limit(); }
+    void            setMemoryLimit(std::size_t limit) { m_allocator.setLimit(limit); }
+
+    /// Stops routing anything to controller, which is going away. Host must be entered.
+    void            forget(Controller &);
+
+public: // Environment::Controller interface for lua
+    void            print(const std::string &) const override;
+    bool            parseColor(const std::string &, RGBAColor *) const override;
+    RenderTarget *  createRenderTarget() override;
+    void            destroyRenderTarget(RenderTarget *) override;
+    int             createThread(lua_State * lua, int nargs) override;
+    void            destroyThread(lua_State * lua, Thread &) override;
+    void            pauseThread(Thread &) override;
+    void            resumeThread(Thread &) override;
+    InterpolatorStore & interpolators() override;
+    const index_list * keyGroupIndices(const KeyDatabase::KeyGroup *) const override;
+
+private:
+    void            setupState(EffectService &);
+
+private:
+    Allocator       m_allocator;    ///< Memory pool and limit for m_state, must outlive it
+    state_ptr       m_state;        ///< LUA container effect scripts run in
+    std::recursive_mutex m_mutex;   ///< Held while an effect uses the host
+    Controller *    m_current;      ///< Effect the host was entered for
+    std::unordered_map<RenderTarget *, Controller *> m_targetOwners; ///< Effect that created each target
+};
+
+/****************************************************************************/
+
+} } } // namespace keyleds::plugin::lua
+
+#endif
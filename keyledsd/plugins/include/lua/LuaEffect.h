@@ -17,17 +17,19 @@
 #ifndef KEYLEDS_PLUGINS_LUA_LUAEFFECT_H_F038C73D
 #define KEYLEDS_PLUGINS_LUA_LUAEFFECT_H_F038C73D
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "keyledsd/PluginHelper.h"
 #include "lua/Environment.h"
+#include "lua/Host.h"
 
 struct lua_State;
 
-namespace std {
-    template <> struct default_delete<lua_State> { void operator()(lua_State *) const; };
-}
-
-
 namespace keyleds { namespace plugin { namespace lua {
 
 /****************************************************************************/
@@ -35,18 +37,39 @@ namespace keyleds { namespace plugin { namespace lua {
 class LuaEffect final : public ::plugin::Effect, public keyleds::lua::Environment::Controller
 {
     using state_ptr = std::unique_ptr<lua_State>;
+    using group_index_map = std::unordered_map<const KeyDatabase::KeyGroup *, index_list>;
+
+    /// Scheduler entry, kept in a min-heap ordered by wake time
+    struct ThreadWakeup final
+    {
+        unsigned long   wakeTime;   ///< Effect time at which thread should be awoken
+        unsigned long   serial;     ///< Entry is stale unless it matches thread's serial
+        int             id;         ///< Thread reference in thread list
+
+        bool operator>(const ThreadWakeup & other) const { return wakeTime > other.wakeTime; }
+    };
 public:
-                    LuaEffect(std::string name, EffectService &, state_ptr);
+                    LuaEffect(std::string name, EffectService &, std::shared_ptr<Host>);
                     LuaEffect(const LuaEffect &) = delete;
                     ~LuaEffect();
 
     // Factory method
     static std::unique_ptr<LuaEffect> create(const std::string & name, EffectService &,
-                                             const std::string & code);
+                                             std::shared_ptr<Host>, const std::string & code);
+    /// Compiles code into a chunk that create() loads without parsing it.
+    /// Returns an empty string and sets error on failure.
+    static std::string compile(const std::string & name, const std::string & code,
+                               std::string * error);
+
+    /// Compiles code in the background, then runs it in place of current script
+    /// on next frame. Current script keeps running if new one fails.
+    void            reloadScript(std::string code);
 
 public: // Effect interface for keyleds & lua init hook
     void            init();
     void            render(unsigned long ms, RenderTarget & target) override;
+    const RenderTarget * renderLayer(unsigned long ms) override;
+    void            frameDone() override;
     void            handleContextChange(const string_map &) override;
     void            handleGenericEvent(const string_map &) override;
     void            handleKeyEvent(const KeyDatabase::Key &, bool) override;
@@ -58,18 +81,43 @@ public: // Environment::Controller interface for lua
     void            destroyRenderTarget(RenderTarget *) override;
     int             createThread(lua_State * lua, int nargs) override;
     void            destroyThread(lua_State * lua, Thread &) override;
+    void            pauseThread(Thread &) override;
+    void            resumeThread(Thread &) override;
+    InterpolatorStore & interpolators() override { return m_interpolators; }
+    const index_list * keyGroupIndices(const KeyDatabase::KeyGroup *) const override;
 
 private:
-           void     setupState();
+           bool     loadScript(const std::string & code);
+           void     compileScript(std::string code);
+           void     applyReload();
+           void     setupEnvironment();
+           void     releaseEnvironment();
            void     stepThreads(unsigned ms);
            void     runThread(Thread &, lua_State * thread, int nargs);
-    static bool     pushHook(lua_State *, const char *);
+           void     scheduleThread(Thread &);
+           void     pushGlobal(lua_State *, const char *) const;
+           bool     pushHook(lua_State *, const char *) const;
     static bool     handleError(lua_State *, EffectService &, int code);
 private:
     std::string     m_name;         ///< Name of the effect, from config file
     EffectService & m_service;      ///< For communicating with keyleds
-    state_ptr       m_state;        ///< Lua container this effect's scripts runs in
+    InterpolatorStore m_interpolators;  ///< Running animations
+    std::shared_ptr<Host> m_host;   ///< Lua container this effect's script runs in, maybe shared
+    int             m_environment;  ///< Registry reference to script's global table
+    int             m_threads;      ///< Registry reference to script's thread list
     bool            m_enabled;      ///< Should render/event handlers be run?
+    unsigned        m_gcStepSize;   ///< Garbage collection work done after each frame, see LUA_GCSTEP
+    string_map      m_context;      ///< Last known context, passed again to reloaded scripts
+    group_index_map m_groupIndices; ///< Sorted key indices of groups exposed to script
+
+    unsigned long   m_time;         ///< Effect time, in milliseconds since creation
+    unsigned long   m_nextSerial;   ///< Serial given to next scheduled thread wakeup
+    std::vector<ThreadWakeup> m_schedule;   ///< Sleeping threads, as a min-heap on wake time
+
+    std::thread     m_compiler;     ///< Compiles reloaded scripts in the background
+    std::mutex      m_reloadLock;   ///< Protects m_reloadChunk
+    std::string     m_reloadChunk;  ///< Compiled script waiting to replace current one
+    std::atomic<bool> m_reloadPending;  ///< Set when m_reloadChunk is ready to be applied
 };
 
 /****************************************************************************/
@@ -0,0 +1,101 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef KEYLEDS_PLUGINS_LUA_WORKER_H_6A1F3E52
+#define KEYLEDS_PLUGINS_LUA_WORKER_H_6A1F3E52
+
+#include <sys/types.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include "keyledsd/PluginHelper.h"
+
+namespace keyleds { namespace plugin { namespace lua {
+
+/****************************************************************************/
+
+/** Lua effect running in a separate process
+ *
+ * Runs a LuaEffect in a child process, so a crashing or runaway script cannot
+ * bring keyledsd down and does not hold the render thread. Events and frame
+ * requests are sent to the worker over a socket. Frames go through shared
+ * memory, as two triple buffers: keyleds hands its target over in one, the
+ * worker renders on top of it and hands the result back in the other.
+ *
+ * Rendering never waits for the worker. Scripts that draw into a layer of their
+ * own, without reading the target, only send that layer back, and the last one
+ * completed is blended onto the live target, so a late worker only delays its
+ * own effect. For other scripts the last frame completed replaces the target, so
+ * lower layers show at least one frame late. A worker that completes no frame
+ * within its deadline is killed, after which the effect draws nothing.
+ *
+ * The worker is forked from keyleds, which has other threads running, and gets
+ * a copy of locks those threads held at that moment, never to be released. So
+ * the worker must only run code that takes no lock but the allocator's, which
+ * glibc resets on fork: the Lua runtime, the effect and logging, which writes
+ * synchronously in forked processes. All descriptors but the socket and the
+ * standard streams are closed as it starts.
+ */
+class Worker final : public ::plugin::Effect
+{
+    struct Shared;
+public:
+    explicit        Worker(EffectService &);
+                    Worker(const Worker &) = delete;
+                    ~Worker();
+
+    // Factory method
+    static std::unique_ptr<Worker> create(const std::string & name, EffectService &,
+                                          const std::string & chunk);
+
+    /// Has the worker run new code in place of current script, see LuaEffect
+    void            reloadScript(const std::string & code);
+
+public: // Effect interface for keyleds
+    void            render(unsigned long ms, RenderTarget & target) override;
+    void            handleContextChange(const string_map &) override;
+    void            handleGenericEvent(const string_map &) override;
+    void            handleKeyEvent(const KeyDatabase::Key &, bool) override;
+
+private:
+           bool     start(const std::string & name, const std::string & chunk);
+    [[noreturn]] void run(const std::string & name, const std::string & chunk);
+           bool     checkWorker();
+           void     stopWorker();
+           bool     send(const std::string & message);
+           RGBAColor * slot(unsigned idx);
+private:
+    EffectService & m_service;      ///< For communicating with keyleds
+    RenderTarget *  m_scratch;      ///< Target the worker renders into
+    Shared *        m_shared;       ///< Shared memory mapping, holding frame exchange and slots
+    std::size_t     m_sharedSize;   ///< Size of shared memory mapping, in bytes
+    std::size_t     m_slotSize;     ///< Size of a frame slot, in colors
+    int             m_socket;       ///< Our end of the socket to the worker
+    pid_t           m_pid;          ///< Worker process, or -1 once it is gone
+    unsigned        m_inputSlot;    ///< Slot keyleds writes its next frame into
+    unsigned        m_outputSlot;   ///< Slot holding the last frame completed by the worker
+    bool            m_hasFrame;     ///< Set once the worker completed a frame
+    bool            m_isLayer;      ///< Set if last frame completed is a layer to blend
+    unsigned long   m_pendingTime;  ///< Time elapsed since last render request worker received
+    unsigned long   m_waitedTime;   ///< Time elapsed since the worker last completed a frame
+    unsigned        m_deadline;     ///< Time after which a worker with no new frame is killed
+};
+
+/****************************************************************************/
+
+} } } // namespace keyleds::plugin::lua
+
+#endif
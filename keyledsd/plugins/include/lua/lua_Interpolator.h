@@ -17,6 +17,13 @@
 #ifndef KEYLEDS_PLUGINS_LUA_LUA_INTERPOLATOR_H_BCD195FC
 #define KEYLEDS_PLUGINS_LUA_LUA_INTERPOLATOR_H_BCD195FC
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "lua/lua_types.h"
 #include "keyledsd/PluginHelper.h"
 
@@ -24,27 +31,96 @@ namespace keyleds { namespace lua {
 
 /****************************************************************************/
 
+/// Curves mapping elapsed time to color progress
+enum class Easing : std::uint8_t { Linear, In, Out, InOut };
+
+/** Multi-stop color gradient.
+ * Stops are evenly spaced. All colors are computed once, on creation, so
+ * sampling the gradient is a simple lookup.
+ */
+class Gradient final
+{
+public:
+    static constexpr unsigned resolution = 256;     ///< Number of steps from first to last stop
+public:
+    explicit        Gradient(const std::vector<RGBAColor> & stops);
+
+    /// Returns color at given progress, in [0, resolution]
+    RGBAColor       operator[](unsigned progress) const { return m_colors[progress]; }
+private:
+    std::array<RGBAColor, resolution + 1> m_colors;
+};
+
 /** Color interpolator for animating keys.
- * This is a lua userdata-based object created using `fade()` from lua.
+ * This is a lua userdata-based object created using `fade()` from lua. It only
+ * holds animation parameters, running animations live in an InterpolatorStore.
  */
 struct Interpolator
 {
     enum {
         hasStartValueFlag = (1 << 1)
     };
-    int         id;                 ///< luaL_ref id in registry
+    unsigned long serial;           ///< Running instance in InterpolatorStore, 0 if never started
     int         flags;              ///< See flags_type above
+    RenderTarget * target;          ///< Render target of last start, only valid while running
     unsigned    index;              ///< Key index withing render target
     unsigned    duration;           ///< Animation duration in ms
-    unsigned    elapsed;            ///< Elapsed time in ms
     RGBAColor   startValue;         ///< Color when elapsed == 0
     RGBAColor   finishValue;        ///< Color when elapsed >= duration
+    Easing      easing;             ///< How color progresses over time
+    std::shared_ptr<const Gradient> gradient;   ///< Colors in between, if more than two
 
     static void start(lua_State *, unsigned index); // on stack: (interpolator, rendertarget) [-2, 0]
     static void stop(lua_State *);                  // on stack: (interpolator) [-1, 0]
-    static void stepAll(lua_State *, unsigned ms);
+};
+
+/** Running interpolators of a lua state.
+ *
+ * Animations are stored natively, as arrays of each of their attributes, so
+ * they can be stepped in a single loop without calling into lua. At most one
+ * animation runs on a given key of a render target, starting another replaces it.
+ */
+class InterpolatorStore final
+{
+public:
+    using serial_type = unsigned long;
+public:
+                    InterpolatorStore();
+                    InterpolatorStore(const InterpolatorStore &) = delete;
+
+    /// Starts an animation, replacing any running on same key. Returns its serial.
+    serial_type     start(RenderTarget *, unsigned index, const Interpolator &,
+                          RGBAColor startValue);
+    /// Tells whether animation with given serial is still running
+    bool            running(RenderTarget *, unsigned index, serial_type) const;
+    /// Stops animation with given serial, if it is still running
+    void            stop(RenderTarget *, unsigned index, serial_type);
+    /// Stops all animations on a render target, before it is destroyed
+    void            removeTarget(const RenderTarget *);
+    /// Advances all animations and updates their keys, removing finished ones
+    void            step(unsigned ms);
+
+    bool            empty() const noexcept { return m_targets.empty(); }
+
+private:
+    using slot_key = std::pair<const RenderTarget *, unsigned>;
+    struct SlotKeyHash final { std::size_t operator()(const slot_key &) const noexcept; };
+
+    void            remove(std::size_t pos);
 
-    RGBAColor   value() const;
+private:
+    std::vector<RenderTarget *> m_targets;      ///< Render target of each animation
+    std::vector<unsigned>       m_indices;      ///< Animated key index within target
+    std::vector<unsigned>       m_elapsed;      ///< Elapsed time in ms
+    std::vector<unsigned>       m_durations;    ///< Animation duration in ms
+    std::vector<RGBAColor>      m_startValues;  ///< Color when elapsed == 0
+    std::vector<RGBAColor>      m_finishValues; ///< Color when elapsed >= duration
+    std::vector<Easing>         m_easings;      ///< How color progresses over time
+    std::vector<std::shared_ptr<const Gradient>> m_gradients;   ///< Multi-stop animations only
+    std::vector<serial_type>    m_serials;      ///< Identifies animations for their Interpolator
+    std::unordered_map<slot_key, std::size_t, SlotKeyHash> m_slots; ///< Position of animation
+                                                                    ///  running on a key
+    serial_type                 m_nextSerial;   ///< Serial of next started animation
 };
 
 int luaNewInterpolator(lua_State *);
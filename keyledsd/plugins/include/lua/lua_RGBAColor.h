@@ -31,9 +31,16 @@ template <> struct metatable<keyleds::RGBAColor>
       static const struct luaL_Reg meta_methods[]; struct weak_table : std::false_type{}; };
 
 void lua_push(lua_State * lua, keyleds::RGBAColor);
+/// Pushes color packed into a number, as 0xRRGGBBAA, which involves no allocation
+void lua_pushpacked(lua_State * lua, keyleds::RGBAColor);
+/// Tells whether value is a color, either a color object or a packed color
+bool lua_iscolor(lua_State * lua, int index);
 RGBAColor lua_tocolor(lua_State * lua, int index);
 RGBAColor lua_checkcolor(lua_State * lua, int index);
 
+int luaPackColor(lua_State *);
+int luaUnpackColor(lua_State *);
+
 /****************************************************************************/
 
 } } // namespace keyleds::lua
@@ -27,9 +27,11 @@ namespace keyleds { namespace lua {
  */
 struct Thread
 {
-    int         id;             ///< unique identifier
+    int         id;             ///< unique identifier, LUA_NOREF once stopped
     bool        running;        ///< whether the thread is currently running (schedulable)
-    unsigned    sleepTime;      ///< time in milliseconds until thread should be awoken
+    unsigned    sleepTime;      ///< time in milliseconds left to sleep, while paused
+    unsigned long wakeTime;     ///< effect time at which thread should be awoken
+    unsigned long serial;       ///< matches the scheduler entry that will wake the thread
 };
 
 int luaNewThread(lua_State *);
@@ -51,6 +51,11 @@ public:
     }
 
     void render(unsigned long ms, RenderTarget & target) override
+    {
+        blend(target, *renderLayer(ms));
+    }
+
+    const RenderTarget * renderLayer(unsigned long ms) override
     {
         m_time += ms;
         if (m_time >= m_period) { m_time -= m_period; }
@@ -64,7 +69,7 @@ public:
         } else {
             for (auto & key : *m_buffer) { key.alpha = alpha; }
         }
-        blend(target, *m_buffer);
+        return m_buffer;
     }
 
 private:
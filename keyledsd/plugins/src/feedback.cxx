@@ -45,6 +45,11 @@ public:
     }
 
     void render(unsigned long ms, RenderTarget & target) override
+    {
+        blend(target, *renderLayer(ms));
+    }
+
+    const RenderTarget * renderLayer(unsigned long ms) override
     {
         const auto lifetime = m_sustain + m_decay;
 
@@ -63,7 +68,7 @@ public:
                            [lifetime](const auto & keyPress){ return keyPress.age >= lifetime; }),
             m_presses.end()
         );
-        blend(target, *m_buffer);
+        return m_buffer;
     }
 
     void handleKeyEvent(const KeyDatabase::Key & key, bool) override
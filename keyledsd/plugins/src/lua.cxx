@@ -17,11 +17,16 @@
 #include <algorithm>
 #include <cassert>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "keyledsd/PluginHelper.h"
 #include "lua/LuaEffect.h"
+#include "lua/Worker.h"
 
+using keyleds::plugin::lua::Host;
 using keyleds::plugin::lua::LuaEffect;
+using keyleds::plugin::lua::Worker;
 
 
 class LuaPlugin final : public keyleds::effect::interface::Plugin
@@ -30,9 +35,23 @@ class LuaPlugin final : public keyleds::effect::interface::Plugin
 
     struct StateInfo {
         std::unique_ptr<LuaEffect>  effect;
+        std::unique_ptr<Worker>     worker;     ///< Set instead of effect for sandboxed effects
+
+        keyleds::effect::interface::Effect * get() const
+        {
+            if (worker) { return worker.get(); }
+            return effect.get();
+        }
     };
     using state_list = std::vector<StateInfo>;
 
+    struct CompiledScript {
+        std::string     source;     ///< Script source the chunk was compiled from
+        std::string     chunk;      ///< Compiled script, loads without parsing
+    };
+    using script_map = std::unordered_map<std::string, CompiledScript>;
+    using host_map = std::unordered_map<std::string, std::weak_ptr<Host>>;
+
 public:
     explicit LuaPlugin(const char *) {}
 
@@ -41,12 +60,29 @@ public:
     keyleds::effect::interface::Effect *
     createEffect(const std::string & name, EffectService & service) override
     {
-        auto source = service.getFile("effects/" + name + ".lua");
+        const auto path = "effects/" + name + ".lua";
+        auto source = service.getFile(path);
         if (source.empty()) { return nullptr; }
 
+        const auto & chunk = compile(name, source, service);
+        if (chunk.empty()) {
+            service.getFile({});
+            return nullptr;
+        }
+
+        if (service.getConfig("sandbox") == "yes") {
+            return createWorker(name, service, path, chunk);
+        }
+
+        auto host = getHost(service);
+        if (!host) {
+            service.getFile({});
+            return nullptr;
+        }
+
         StateInfo info;
         try {
-            info.effect = LuaEffect::create(name, service, source);
+            info.effect = LuaEffect::create(name, service, std::move(host), chunk);
         } catch (std::exception & err) {
             service.log(2, err.what());
             return nullptr;
@@ -56,23 +92,93 @@ public:
 
         if (!info.effect) { return nullptr; }
 
+        // Pick up script changes while the effect is running
+        auto * effect = info.effect.get();
+        service.watchFile(path, [effect, &service, path]() {
+            const auto & code = service.getFile(path);
+            if (!code.empty()) { effect->reloadScript(code); }
+            service.getFile({});
+        });
+
         m_states.push_back(std::move(info));
-        return m_states.back().effect.get();
+        return m_states.back().get();
     }
 
     void destroyEffect(keyleds::effect::interface::Effect * ptr, EffectService &) override
     {
         auto it = std::find_if(m_states.begin(), m_states.end(),
-                               [ptr](const auto & state) { return state.effect.get() == ptr; });
+                               [ptr](const auto & state) { return state.get() == ptr; });
         assert(it != m_states.end());
 
         std::iter_swap(it, m_states.end() - 1);
         m_states.pop_back();
     }
 
+private:
+    /// Creates an effect running in a worker process, which creates its own host
+    keyleds::effect::interface::Effect *
+    createWorker(const std::string & name, EffectService & service, const std::string & path,
+                 const std::string & chunk)
+    {
+        StateInfo info;
+        info.worker = Worker::create(name, service, chunk);
+        service.getFile({});    // let the service clear file data
+
+        if (!info.worker) { return nullptr; }
+
+        auto * worker = info.worker.get();
+        service.watchFile(path, [worker, &service, path]() {
+            const auto & code = service.getFile(path);
+            if (!code.empty()) { worker->reloadScript(code); }
+            service.getFile({});
+        });
+
+        m_states.push_back(std::move(info));
+        return m_states.back().get();
+    }
+
+    /// Returns a host for the effect, shared with other effects on same device if it asks to
+    std::shared_ptr<Host> getHost(EffectService & service)
+    {
+        if (service.getConfig("share-state") != "yes") { return Host::create(service); }
+
+        // Drop hosts whose effects are all gone
+        for (auto it = m_hosts.begin(); it != m_hosts.end(); ) {
+            if (it->second.expired()) { it = m_hosts.erase(it); } else { ++it; }
+        }
+
+        auto & entry = m_hosts[service.deviceSerial()];
+        auto host = entry.lock();
+        if (!host) {
+            host = Host::create(service);
+            entry = host;
+        }
+        return host;
+    }
+
+    /// Returns compiled script, compiling it only if source changed since last time
+    const std::string & compile(const std::string & name, const std::string & source,
+                                EffectService & service)
+    {
+        auto & script = m_scripts[name];
+        if (script.chunk.empty() || script.source != source) {
+            std::string error;
+            script.chunk = LuaEffect::compile(name, source, &error);
+            if (script.chunk.empty()) {
+                service.log(2, error.c_str());
+                m_scripts.erase(name);
+                static const std::string empty;
+                return empty;
+            }
+            script.source = source;
+        }
+        return script.chunk;
+    }
 
 private:
     state_list  m_states;
+    script_map  m_scripts;      ///< Compiled scripts, by effect name
+    host_map    m_hosts;        ///< Hosts shared by effects, by device serial
 };
 
 
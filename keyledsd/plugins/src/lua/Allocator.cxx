@@ -0,0 +1,121 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/Allocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using keyleds::plugin::lua::Allocator;
+
+constexpr std::size_t Allocator::granularity;
+constexpr std::size_t Allocator::classCount;
+constexpr std::size_t Allocator::maxPooledSize;
+constexpr std::size_t Allocator::arenaSize;
+
+/****************************************************************************/
+
+Allocator::Allocator(std::size_t limit)
+ : m_limit(limit),
+   m_used(0),
+   m_arenaNext(nullptr),
+   m_arenaEnd(nullptr)
+{
+    m_free.fill(nullptr);
+}
+
+Allocator::~Allocator() {}
+
+void * Allocator::allocate(void * ud, void * ptr, std::size_t osize, std::size_t nsize)
+{
+    return static_cast<Allocator *>(ud)->reallocate(ptr, osize, nsize);
+}
+
+void * Allocator::reallocate(void * ptr, std::size_t osize, std::size_t nsize)
+{
+    if (ptr == nullptr) { osize = 0; }      // LUA 5.2+ passes object type in osize
+
+    if (nsize == 0) {
+        if (ptr != nullptr) {
+            if (osize <= maxPooledSize) { give(ptr, sizeClass(osize)); } else { std::free(ptr); }
+            m_used -= osize;
+        }
+        return nullptr;
+    }
+
+    // Only growing may fail, LUA assumes shrinking blocks always succeeds
+    if (m_limit > 0 && nsize > osize && m_used + (nsize - osize) > m_limit) { return nullptr; }
+
+    const bool wasPooled = ptr != nullptr && osize <= maxPooledSize;
+    const bool isPooled = nsize <= maxPooledSize;
+    void * result;
+
+    if (wasPooled && isPooled && sizeClass(osize) == sizeClass(nsize)) {
+        result = ptr;
+    } else if (ptr != nullptr && !wasPooled && !isPooled) {
+        result = std::realloc(ptr, nsize);
+        if (result == nullptr) { return nullptr; }
+    } else {
+        result = isPooled ? take(sizeClass(nsize)) : std::malloc(nsize);
+        if (result == nullptr) {
+            if (ptr == nullptr || wasPooled || !isPooled) { return nullptr; }
+            // Shrinking into pooled range with no block left, keep a system block sized
+            // for its class. It joins the pool once freed, and is lost on destruction.
+            result = std::realloc(ptr, (sizeClass(nsize) + 1) * granularity);
+            m_used = m_used - osize + nsize;
+            return result != nullptr ? result : ptr;
+        }
+        if (ptr != nullptr) {
+            std::memcpy(result, ptr, std::min(osize, nsize));
+            if (wasPooled) { give(ptr, sizeClass(osize)); } else { std::free(ptr); }
+        }
+    }
+    m_used = m_used - osize + nsize;
+    return result;
+}
+
+void * Allocator::take(std::size_t cls)
+{
+    auto * block = m_free[cls];
+    if (block != nullptr) {
+        m_free[cls] = block->next;
+        return block;
+    }
+
+    const auto size = (cls + 1) * granularity;
+    if (static_cast<std::size_t>(m_arenaEnd - m_arenaNext) < size) {
+        // Called from LUA, which cannot propagate exceptions
+        try {
+            m_arenas.push_back(std::make_unique<char[]>(arenaSize));
+        } catch (std::bad_alloc &) {
+            return nullptr;
+        }
+        m_arenaNext = m_arenas.back().get();
+        m_arenaEnd = m_arenaNext + arenaSize;
+    }
+    auto * result = m_arenaNext;
+    m_arenaNext += size;
+    return result;
+}
+
+void Allocator::give(void * ptr, std::size_t cls)
+{
+    auto * block = static_cast<Block *>(ptr);
+    block->next = m_free[cls];
+    m_free[cls] = block;
+}
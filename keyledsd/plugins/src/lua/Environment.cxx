@@ -54,7 +54,13 @@ static int luaToColor(lua_State * lua)      // (any) => (table)
     int nargs = lua_gettop(lua);
     if (nargs == 1) {
         // We are called as a conversion function
-        if (lua_isstring(lua, 1)) {
+        if (lua_type(lua, 1) == LUA_TNUMBER) {
+            // On a packed color, unpack it
+            if (lua_iscolor(lua, 1)) {
+                lua_push(lua, lua_tocolor(lua, 1));
+                return 1;
+            }
+        } else if (lua_isstring(lua, 1)) {
             // On a string, parse it
             auto * controller = Environment(lua).controller();
             if (!controller) { return luaL_error(lua, noEffectTokenErrorMessage); }
@@ -99,9 +105,11 @@ static int luaWait(lua_State * lua)
 
 static const luaL_Reg keyledsGlobals[] = {
     { "fade",       luaNewInterpolator },
+    { "packcolor",  luaPackColor },
     { "print",      luaPrint    },
     { "thread",     luaNewThread },
     { "tocolor",    luaToColor  },
+    { "unpackcolor", luaUnpackColor },
     { "wait",       luaWait     },
     { nullptr, nullptr }
 };
@@ -0,0 +1,239 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/Host.h"
+
+#include <lua.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include "keyledsd/utils.h"
+#include "lua/lua_common.h"
+
+using keyleds::plugin::lua::Host;
+using namespace keyleds::lua;
+
+/****************************************************************************/
+// Constants defining LUA environment
+
+// LUA libraries to load
+static constexpr std::array<lua_CFunction, 4> loadModules = {{
+    luaopen_base, luaopen_math, luaopen_string, luaopen_table,
+}};
+static_assert(loadModules.back() == luaopen_table,
+              "unexpected last element, is size correct?");
+
+// Symbols not in this list get removed once libraries are loaded
+static constexpr std::array<const char *, 25> globalWhitelist = {{
+    // Libraries
+    "coroutine", "math", "string", "table",
+    // Functions
+    "assert", "error", "getmetatable", "ipairs",
+    "next", "pairs", "pcall", "print",
+    "rawequal", "rawget", "rawset", "select",
+    "setmetatable", "tonumber", "tostring", "type",
+    "unpack", "wait", "xpcall",
+    // Values
+    "_G", "_VERSION"
+}};
+
+static constexpr unsigned defaultMemoryLimit = 16384;   // kilobytes
+
+static int luaPanicHandler(lua_State *) { abort(); }
+
+/****************************************************************************/
+// Lifecycle management
+
+std::shared_ptr<Host> Host::create(EffectService & service)
+{
+    unsigned limit = defaultMemoryLimit;
+    keyleds::parseNumber(service.getConfig("memory-limit"), &limit);
+
+    auto host = std::make_shared<Host>(std::size_t(limit) * 1024);
+    if (!host->m_state) {
+        // 64-bit LuaJIT can only use its own allocator, unless built with GC64
+        service.log(4, "custom allocator not supported, memory-limit is not enforced");
+        host->m_state.reset(luaL_newstate());
+        if (!host->m_state) { return nullptr; }
+    }
+    host->setupState(service);
+    return host;
+}
+
+Host::Host(std::size_t memoryLimit)
+ : m_allocator(memoryLimit),
+   m_state(lua_newstate(Allocator::allocate, &m_allocator)),
+   m_current(nullptr)
+{}
+
+Host::~Host() {}
+
+void Host::setupState(EffectService & service)
+{
+    auto lua = m_state.get();
+    lua_atpanic(lua, luaPanicHandler);
+    SAVE_TOP(lua);
+
+    // Tune collector, which also runs in small steps after each frame
+    unsigned value;
+    if (keyleds::parseNumber(service.getConfig("gc-pause"), &value)) {
+        lua_gc(lua, LUA_GCSETPAUSE, int(value));
+    }
+    if (keyleds::parseNumber(service.getConfig("gc-stepmul"), &value)) {
+        lua_gc(lua, LUA_GCSETSTEPMUL, int(value));
+    }
+
+    // Load libraries in default environment
+    for (const auto & module : loadModules) {
+        lua_pushcfunction(lua, module);
+        lua_call(lua, 0, 0);
+    }
+
+    // Remove global symbols not in whitelist
+    lua_pushnil(lua);
+    while (lua_next(lua, LUA_GLOBALSINDEX) != 0) {
+        lua_pop(lua, 1);
+        if (lua_isstring(lua, -1)) {
+            const char * key = lua_tostring(lua, -1);
+            auto it = std::find_if(globalWhitelist.begin(), globalWhitelist.end(),
+                                   [key](const auto * item) { return std::strcmp(key, item) == 0; });
+            if (it == globalWhitelist.end()) {
+                lua_pushnil(lua);
+                lua_setglobal(lua, key);
+            }
+        }
+    }
+
+    // Load keyleds library, passing ourselves as controller
+    Environment(lua).openKeyleds(this);
+
+    // Engine looks up key names in keyleds.db of shared globals, scripts see their own keyleds
+    lua_createtable(lua, 0, 1);
+    lua_push(lua, &service.keyDB());
+    lua_setfield(lua, -2, "db");
+    lua_setglobal(lua, "keyleds");
+
+    // Add debug module if configuration requests it
+    if (service.getConfig("debug") == "yes") {
+        lua_pushcfunction(lua, luaopen_debug);
+        lua_call(lua, 0, 0);
+    }
+
+    CHECK_TOP(lua, 0);
+}
+
+void Host::forget(Controller & controller)
+{
+    for (auto it = m_targetOwners.begin(); it != m_targetOwners.end(); ) {
+        if (it->second == &controller) {
+            it = m_targetOwners.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/****************************************************************************/
+
+Host::Entry::Entry(Host & host, Controller & controller)
+ : m_host(host),
+   m_lock(host.m_mutex),
+   m_previous(host.m_current)
+{
+    host.m_current = &controller;
+}
+
+Host::Entry::~Entry()
+{
+    m_host.m_current = m_previous;
+}
+
+/****************************************************************************/
+// Lua interface
+
+void Host::print(const std::string & msg) const
+{
+    assert(m_current);
+    m_current->print(msg);
+}
+
+bool Host::parseColor(const std::string & str, RGBAColor * color) const
+{
+    assert(m_current);
+    return m_current->parseColor(str, color);
+}
+
+keyleds::RenderTarget * Host::createRenderTarget()
+{
+    assert(m_current);
+    auto * target = m_current->createRenderTarget();
+    m_targetOwners.emplace(target, m_current);
+    return target;
+}
+
+void Host::destroyRenderTarget(RenderTarget * target)
+{
+    auto it = m_targetOwners.find(target);
+    if (it == m_targetOwners.end()) { return; }     // its effect is gone, and its targets with it
+    auto * owner = it->second;
+    m_targetOwners.erase(it);
+    owner->destroyRenderTarget(target);
+}
+
+int Host::createThread(lua_State * lua, int nargs)
+{
+    assert(m_current);
+    return m_current->createThread(lua, nargs);
+}
+
+void Host::destroyThread(lua_State * lua, Thread & thread)
+{
+    assert(m_current);
+    m_current->destroyThread(lua, thread);
+}
+
+void Host::pauseThread(Thread & thread)
+{
+    assert(m_current);
+    m_current->pauseThread(thread);
+}
+
+void Host::resumeThread(Thread & thread)
+{
+    assert(m_current);
+    m_current->resumeThread(thread);
+}
+
+keyleds::lua::InterpolatorStore & Host::interpolators()
+{
+    assert(m_current);
+    return m_current->interpolators();
+}
+
+const Host::index_list * Host::keyGroupIndices(const KeyDatabase::KeyGroup * group) const
+{
+    assert(m_current);
+    return m_current->keyGroupIndices(group);
+}
+
+/****************************************************************************/
+
+// Ensure unique_ptr works on lua_State
+namespace std {
+    void default_delete<lua_State>::operator()(lua_State *p) const { lua_close(p); }
+}
@@ -19,135 +19,188 @@
 #include <lua.hpp>
 #include <algorithm>
 #include <cassert>
-#include <cstring>
+#include <functional>
 #include <sstream>
+#include "keyledsd/utils.h"
 #include "lua/Environment.h"
 #include "lua/lua_common.h"
 
 using keyleds::plugin::lua::LuaEffect;
 using namespace keyleds::lua;
 
-/****************************************************************************/
-// Constants defining LUA environment
-
-// LUA libraries to load
-static constexpr std::array<lua_CFunction, 4> loadModules = {{
-    luaopen_base, luaopen_math, luaopen_string, luaopen_table,
-}};
-static_assert(loadModules.back() == luaopen_table,
-              "unexpected last element, is size correct?");
-
-// Symbols not in this list get removed once libraries are loaded
-static constexpr std::array<const char *, 25> globalWhitelist = {{
-    // Libraries
-    "coroutine", "math", "string", "table",
-    // Functions
-    "assert", "error", "getmetatable", "ipairs",
-    "next", "pairs", "pcall", "print",
-    "rawequal", "rawget", "rawset", "select",
-    "setmetatable", "tonumber", "tostring", "type",
-    "unpack", "wait", "xpcall",
-    // Values
-    "_G", "_VERSION"
-}};
-
-static const void * const threadToken = &threadToken;
-
 /****************************************************************************/
 // Helper functions
 
 static int luaPanicHandler(lua_State *);
 static int luaErrorHandler(lua_State *);
+static int writeChunk(lua_State *, const void *, size_t, void *);
 
 /****************************************************************************/
 // Lifecycle management
 
-LuaEffect::LuaEffect(std::string name, EffectService & service, state_ptr state)
+LuaEffect::LuaEffect(std::string name, EffectService & service, std::shared_ptr<Host> host)
  : m_name(std::move(name)),
    m_service(service),
-   m_state(std::move(state)),
-   m_enabled(true)
-{}
+   m_host(std::move(host)),
+   m_environment(LUA_NOREF),
+   m_threads(LUA_NOREF),
+   m_enabled(true),
+   m_gcStepSize(0),
+   m_time(0),
+   m_nextSerial(0),
+   m_reloadPending(false)
+{
+    keyleds::parseNumber(m_service.getConfig("gc-step"), &m_gcStepSize);
+}
 
-LuaEffect::~LuaEffect() {}
+LuaEffect::~LuaEffect()
+{
+    if (m_compiler.joinable()) { m_compiler.join(); }
+
+    // Collect our objects while we can still destroy them, other effects may keep the host
+    Host::Entry entry(*m_host, *this);
+    releaseEnvironment();
+    lua_gc(m_host->state(), LUA_GCCOLLECT, 0);
+    m_host->forget(*this);
+}
 
 std::unique_ptr<LuaEffect> LuaEffect::create(const std::string & name, EffectService & service,
-                                             const std::string & code)
+                                             std::shared_ptr<Host> host, const std::string & code)
 {
-    // Create a LUA state
-    state_ptr state(luaL_newstate());
-    auto * lua = state.get();
-    lua_atpanic(lua, luaPanicHandler);
+    auto effect = std::make_unique<LuaEffect>(name, service, std::move(host));
+    Host::Entry entry(*effect->m_host, *effect);
+    if (!effect->loadScript(code)) { return nullptr; }
+
+    // Let the effect run init hook
+    effect->init();
+    return effect;
+}
 
+/// Runs the script in a new environment. Leaves no environment on failure.
+bool LuaEffect::loadScript(const std::string & code)
+{
+    auto * lua = m_host->state();
     SAVE_TOP(lua);
 
-    // Load script
-    if (luaL_loadbuffer(lua, code.data(), code.size(), name.c_str()) != 0) {
-        service.log(2, lua_tostring(lua, -1));
-        return nullptr;
+    // Load script, either source or compiled chunk
+    if (luaL_loadbuffer(lua, code.data(), code.size(), m_name.c_str()) != 0) {
+        m_service.log(2, lua_tostring(lua, -1));
+        lua_pop(lua, 1);                    // pop (message)
+        return false;
     }                                       // ^push (script)
 
-    auto effect = std::make_unique<LuaEffect>(name, service, std::move(state));
-    effect->setupState();
+    setupEnvironment();
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_environment); // push (env)
+    lua_setfenv(lua, -2);                   // pop (env)
 
     // Run script to let it build its environment
     lua_pushcfunction(lua, luaErrorHandler);// push (errhandler)
     lua_insert(lua, -2);                    // swap (script, errhandler) => (errhandler, script)
-    if (!handleError(lua, service, lua_pcall(lua, 0, 0, -2))) { // pop (errhandler, script)
-        return nullptr;
+    if (!handleError(lua, m_service, lua_pcall(lua, 0, 0, -2))) { // pop (errhandler, script)
+        releaseEnvironment();
+        return false;
     }
 
     CHECK_TOP(lua, 0);
+    return true;
+}
 
-    // Let the effect run init hook
-    effect->init();
-    return effect;
+void LuaEffect::reloadScript(std::string code)
+{
+    if (m_compiler.joinable()) { m_compiler.join(); }
+    m_compiler = std::thread(&LuaEffect::compileScript, this, std::move(code));
 }
 
-void LuaEffect::setupState()
+std::string LuaEffect::compile(const std::string & name, const std::string & code,
+                               std::string * error)
 {
-    auto lua = m_state.get();
-    SAVE_TOP(lua);
+    state_ptr state(luaL_newstate());
+    auto * lua = state.get();
+    lua_atpanic(lua, luaPanicHandler);
 
-    // Load libraries in default environment
-    for (const auto & module : loadModules) {
-        lua_pushcfunction(lua, module);
-        lua_call(lua, 0, 0);
+    std::string chunk;
+    if (luaL_loadbuffer(lua, code.data(), code.size(), name.c_str()) != 0) {
+        if (error) { *error = lua_tostring(lua, -1); }
+        return chunk;
     }
+    lua_dump(lua, writeChunk, &chunk);
+    return chunk;
+}
 
-    // Remove global symbols not in whitelist
-    lua_pushnil(lua);
-    while (lua_next(lua, LUA_GLOBALSINDEX) != 0) {
-        lua_pop(lua, 1);
-        if (lua_isstring(lua, -1)) {
-            const char * key = lua_tostring(lua, -1);
-            auto it = std::find_if(globalWhitelist.begin(), globalWhitelist.end(),
-                                   [key](const auto * item) { return std::strcmp(key, item) == 0; });
-            if (it == globalWhitelist.end()) {
-                lua_pushnil(lua);
-                lua_setglobal(lua, key);
-            }
-        }
+/// Reload compilation, runs on m_compiler thread
+void LuaEffect::compileScript(std::string code)
+{
+    std::string error;
+    auto chunk = compile(m_name, code, &error);
+    if (chunk.empty()) {
+        m_service.log(2, error.c_str());
+        return;
     }
 
-    // Load keyleds library, passing ourselves as controller
-    Environment(lua).openKeyleds(this);
+    std::lock_guard<std::mutex> lock(m_reloadLock);
+    m_reloadChunk = std::move(chunk);
+    m_reloadPending.store(true, std::memory_order_release);
+}
 
-    // Add debug module if configuration requests it
-    if (m_service.getConfig("debug") == "yes") {
-        lua_pushcfunction(lua, luaopen_debug);
-        lua_call(lua, 0, 0);
+/// Swaps in reloaded script, runs on render thread between frames
+void LuaEffect::applyReload()
+{
+    std::string chunk;
+    {
+        std::lock_guard<std::mutex> lock(m_reloadLock);
+        chunk = std::move(m_reloadChunk);
+        m_reloadPending.store(false, std::memory_order_relaxed);
     }
 
-    // Insert thread list
-    lua_pushlightuserdata(lua, const_cast<void *>(threadToken));
+    const auto previousEnvironment = m_environment;
+    const auto previousThreads = m_threads;
+    const bool wasEnabled = m_enabled;
+    m_environment = m_threads = LUA_NOREF;
+    m_enabled = true;
+
+    // Previous script is alive until the new one is proven, do not count it against the limit
+    const auto limit = m_host->memoryLimit();
+    if (limit > 0) { m_host->setMemoryLimit(limit + m_host->memoryUsed()); }
+    if (loadScript(chunk)) { init(); }
+    m_host->setMemoryLimit(limit);
+
+    if (m_environment == LUA_NOREF || !m_enabled) {
+        releaseEnvironment();
+        m_environment = previousEnvironment;
+        m_threads = previousThreads;
+        m_enabled = wasEnabled;
+        m_service.log(2, "reloading failed, keeping previous script");
+        return;
+    }
+    luaL_unref(m_host->state(), LUA_REGISTRYINDEX, previousEnvironment);
+    luaL_unref(m_host->state(), LUA_REGISTRYINDEX, previousThreads);
+    m_service.log(3, "script reloaded");
+    handleContextChange(m_context);
+}
+
+/// Creates the script's global table, which falls back to shared globals for reading
+void LuaEffect::setupEnvironment()
+{
+    auto lua = m_host->state();
+    SAVE_TOP(lua);
+
+    // Create thread list
     lua_newtable(lua);
-    lua_rawset(lua, LUA_REGISTRYINDEX);
+    m_threads = luaL_ref(lua, LUA_REGISTRYINDEX);
+
+    // Create environment
+    lua_createtable(lua, 0, 8);                 // push(env)
+    lua_pushvalue(lua, -1);
+    lua_setfield(lua, -2, "_G");
+    lua_createtable(lua, 0, 1);                 // push(meta)
+    lua_pushvalue(lua, LUA_GLOBALSINDEX);
+    lua_setfield(lua, -2, "__index");
+    lua_setmetatable(lua, -2);                  // pop(meta)
 
     // Set keyleds members
     lua_createtable(lua, 0, 6);
     lua_pushvalue(lua, -1);
-    lua_setglobal(lua, "keyleds");
+    lua_setfield(lua, -3, "keyleds");
     {
         lua_pushlstring(lua, m_service.deviceName().data(), m_service.deviceName().size());
         lua_setfield(lua, -2, "deviceName");
@@ -165,9 +218,16 @@ void LuaEffect::setupState()
         }
         lua_setfield(lua, -2, "config");
 
+        // Index lists are computed once here, so drawing into a group does not walk its keys
         auto & groups = m_service.keyGroups();
+        m_groupIndices.clear();
         lua_createtable(lua, 0, groups.size());
         for (const auto & group : groups) {
+            auto & indices = m_groupIndices[&group];
+            indices.reserve(group.size());
+            for (const auto & key : group) { indices.push_back(key.index); }
+            std::sort(indices.begin(), indices.end());
+
             lua_pushlstring(lua, group.name().data(), group.name().size());
             lua_push(lua, &group);
             lua_rawset(lua, -3);
@@ -179,16 +239,25 @@ void LuaEffect::setupState()
     }
     lua_pop(lua, 1);        // pop(keyleds)
 
+    m_environment = luaL_ref(lua, LUA_REGISTRYINDEX);   // pop(env)
     CHECK_TOP(lua, 0);
 }
 
+void LuaEffect::releaseEnvironment()
+{
+    luaL_unref(m_host->state(), LUA_REGISTRYINDEX, m_environment);
+    luaL_unref(m_host->state(), LUA_REGISTRYINDEX, m_threads);
+    m_environment = m_threads = LUA_NOREF;
+}
+
 /****************************************************************************/
 // Hooks
 
 void LuaEffect::init()
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    Host::Entry entry(*m_host, *this);
+    auto lua = m_host->state();
     SAVE_TOP(lua);
 
     if (pushHook(lua, "init")) {                    // push(init)
@@ -204,10 +273,19 @@ void LuaEffect::init()
 
 void LuaEffect::render(unsigned long ms, RenderTarget & target)
 {
+    Host::Entry entry(*m_host, *this);
+    if (m_reloadPending.load(std::memory_order_acquire)) { applyReload(); }
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    auto lua = m_host->state();
 
-    Environment(lua).stepInterpolators(ms);
+    // Scripts that expose a layer render into it, then we blend it in their stead
+    auto * layer = renderLayer(ms);
+    if (layer) {
+        blend(target, *layer);
+        return;
+    }
+
+    m_interpolators.step(ms);
     stepThreads(ms);
 
     SAVE_TOP(lua);
@@ -227,13 +305,60 @@ void LuaEffect::render(unsigned long ms, RenderTarget & target)
 
     lua_to<RenderTarget *>(lua, -1) = nullptr;      // mark target as gone
     lua_pop(lua, 1);
+    if (!m_interpolators.empty()) { m_interpolators.removeTarget(&target); }
     CHECK_TOP(lua, 0);
 }
 
+const keyleds::RenderTarget * LuaEffect::renderLayer(unsigned long ms)
+{
+    Host::Entry entry(*m_host, *this);
+    if (m_reloadPending.load(std::memory_order_acquire)) { applyReload(); }
+    if (!m_enabled) { return nullptr; }
+    auto lua = m_host->state();
+    SAVE_TOP(lua);
+
+    pushGlobal(lua, "layer");                       // push(layer)
+    if (!lua_is<RenderTarget *>(lua, -1) || !lua_to<RenderTarget *>(lua, -1)) {
+        lua_pop(lua, 1);                            // pop(layer)
+        CHECK_TOP(lua, 0);
+        return nullptr;
+    }
+    auto * layer = lua_to<RenderTarget *>(lua, -1);
+
+    m_interpolators.step(ms);
+    stepThreads(ms);
+
+    lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
+    if (pushHook(lua, "render")) {                  // push(render)
+        lua_pushinteger(lua, ms);                   // push(arg1)
+        lua_pushvalue(lua, -4);                     // push(arg2)
+        if (!handleError(lua, m_service,
+                         lua_pcall(lua, 2, 0, -4))) {// pop(errhandler, render, arg1, arg2)
+            m_enabled = false;
+        }
+    } else {
+        lua_pop(lua, 1);                            // pop(errhandler)
+    }
+
+    lua_pop(lua, 1);                                // pop(layer)
+    CHECK_TOP(lua, 0);
+    return layer;
+}
+
+/// Runs garbage collection between frames, so it rarely needs to run within hooks
+void LuaEffect::frameDone()
+{
+    if (!m_enabled) { return; }
+    Host::Entry entry(*m_host, *this);
+    lua_gc(m_host->state(), LUA_GCSTEP, int(m_gcStepSize));
+}
+
 void LuaEffect::handleContextChange(const string_map & data)
 {
+    if (&data != &m_context) { m_context = data; }
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    Host::Entry entry(*m_host, *this);
+    auto lua = m_host->state();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onContextChange")) {         // push(hook)
@@ -255,7 +380,8 @@ void LuaEffect::handleContextChange(const string_map & data)
 void LuaEffect::handleGenericEvent(const string_map & data)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    Host::Entry entry(*m_host, *this);
+    auto lua = m_host->state();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onGenericEvent")) {          // push(hook)
@@ -277,7 +403,8 @@ void LuaEffect::handleGenericEvent(const string_map & data)
 void LuaEffect::handleKeyEvent(const KeyDatabase::Key & key, bool press)
 {
     if (!m_enabled) { return; }
-    auto lua = m_state.get();
+    Host::Entry entry(*m_host, *this);
+    auto lua = m_host->state();
     SAVE_TOP(lua);
     lua_pushcfunction(lua, luaErrorHandler);        // push(errhandler)
     if (pushHook(lua, "onKeyEvent")) {              // push(hook)
@@ -313,6 +440,7 @@ keyleds::RenderTarget * LuaEffect::createRenderTarget()
 
 void LuaEffect::destroyRenderTarget(RenderTarget * target)
 {
+    m_interpolators.removeTarget(target);
     m_service.destroyRenderTarget(target);
 }
 
@@ -320,15 +448,14 @@ void LuaEffect::destroyRenderTarget(RenderTarget * target)
 int LuaEffect::createThread(lua_State * lua, int nargs)
 {
     SAVE_TOP(lua);
-    lua_push(lua, Thread{0, true, 0});              // push(thread)
+    lua_push(lua, Thread{0, true, 0, m_time, 0});   // push(thread)
 
     lua_createtable(lua, 0, 1);                     // push(fenv)
-    auto * thread = lua_newthread(m_state.get());   // push(thread)
+    auto * thread = lua_newthread(m_host->state()); // push(thread)
     lua_setfield(lua, -2, "thread");                // pop(thread)
     lua_setfenv(lua, -2);                           // pop(fenv)
 
-    lua_pushlightuserdata(lua, const_cast<void *>(threadToken)); // push(token)
-    lua_rawget(lua, LUA_REGISTRYINDEX);             // pop(token) push(threadlist)
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads); // push(threadlist)
     lua_pushvalue(lua, -2);                         // push(thread)
     auto id = luaL_ref(lua, -2);                    // pop(thread)
     lua_to<Thread>(lua, -2).id = id;
@@ -345,60 +472,85 @@ int LuaEffect::createThread(lua_State * lua, int nargs)
 
 void LuaEffect::destroyThread(lua_State * lua, Thread & thread)
 {
+    if (thread.id == LUA_NOREF) { return; }
     SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, const_cast<void *>(threadToken));
-    lua_rawget(lua, LUA_REGISTRYINDEX);
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads);
 
     luaL_unref(lua, -1, thread.id);
     lua_pop(lua, 1);
+    thread.id = LUA_NOREF;
     thread.running = false;
     CHECK_TOP(lua, 0);
 }
 
+void LuaEffect::pauseThread(Thread & thread)
+{
+    if (!thread.running) { return; }
+    thread.running = false;         // invalidates its scheduler entry
+    thread.sleepTime = thread.wakeTime > m_time ? unsigned(thread.wakeTime - m_time) : 0;
+}
+
+void LuaEffect::resumeThread(Thread & thread)
+{
+    if (thread.running || thread.id == LUA_NOREF) { return; }
+    thread.running = true;
+    thread.wakeTime = m_time + thread.sleepTime;
+    scheduleThread(thread);
+}
+
+const LuaEffect::index_list *
+LuaEffect::keyGroupIndices(const KeyDatabase::KeyGroup * group) const
+{
+    auto it = m_groupIndices.find(group);
+    return it != m_groupIndices.end() ? &it->second : nullptr;
+}
+
+void LuaEffect::scheduleThread(Thread & thread)
+{
+    thread.serial = m_nextSerial++;
+    m_schedule.push_back({thread.wakeTime, thread.serial, thread.id});
+    std::push_heap(m_schedule.begin(), m_schedule.end(), std::greater<ThreadWakeup>());
+}
+
 void LuaEffect::stepThreads(unsigned ms)
 {
-    auto * lua = m_state.get();
+    m_time += ms;
+    if (m_schedule.empty() || m_schedule.front().wakeTime > m_time) { return; }
+
+    auto * lua = m_host->state();
     SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, const_cast<void *>(threadToken));
-    lua_rawget(lua, LUA_REGISTRYINDEX);
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_threads);     // push(threadlist)
 
-    size_t size = lua_objlen(lua, -1);
-    for (size_t index = 1; index <= size; ++index) {
-        lua_rawgeti(lua, -1, index);                    // push(threadInfo)
+    // Threads that sleep less than a frame are run again until they catch up
+    while (!m_schedule.empty() && m_schedule.front().wakeTime <= m_time) {
+        std::pop_heap(m_schedule.begin(), m_schedule.end(), std::greater<ThreadWakeup>());
+        const auto entry = m_schedule.back();
+        m_schedule.pop_back();
+
+        lua_rawgeti(lua, -1, entry.id);                 // push(threadInfo)
         if (!lua_is<Thread>(lua, -1)) {
-            lua_pop(lua, 1);                            // (pop(threadInfo))
+            lua_pop(lua, 1);                            // pop(threadInfo)
             continue;
         }
-
         auto & threadInfo = lua_to<Thread>(lua, -1);
-
-        if (threadInfo.running) {
-            if (threadInfo.sleepTime <= ms) {
-                lua_getfenv(lua, -1);                   // push(fenv)
-                lua_getfield(lua, -1, "thread");        // push(thread)
-                auto * thread = static_cast<lua_State *>(const_cast<void *>(lua_topointer(lua, -1)));
-
-                while (threadInfo.running && threadInfo.sleepTime <= ms) {
-                    runThread(threadInfo, thread, 0);
-                }
-
-                lua_pop(lua, 2);                        // pop(fenv, thread)
-            }
-            if (threadInfo.sleepTime > ms) {
-                threadInfo.sleepTime -= ms;
-            } else {
-                threadInfo.sleepTime = 0;
-            }
+        if (!threadInfo.running || threadInfo.serial != entry.serial) {
+            lua_pop(lua, 1);                            // pop(threadInfo) - stale entry
+            continue;
         }
-        lua_pop(lua, 1);                                // pop(threadInfo)
+
+        lua_getfenv(lua, -1);                           // push(fenv)
+        lua_getfield(lua, -1, "thread");                // push(thread)
+        auto * thread = static_cast<lua_State *>(const_cast<void *>(lua_topointer(lua, -1)));
+        runThread(threadInfo, thread, 0);
+        lua_pop(lua, 3);                                // pop(threadInfo, fenv, thread)
     }
-    lua_pop(lua, 1);                                    // pop(animlist)
+    lua_pop(lua, 1);                                    // pop(threadlist)
     CHECK_TOP(lua, 0);
 }
 
 void LuaEffect::runThread(Thread & threadInfo, lua_State * thread, int nargs)
 {
-    auto * lua = m_state.get();
+    auto * lua = m_host->state();
     SAVE_TOP(lua);
 
     bool terminate = true;
@@ -412,9 +564,19 @@ void LuaEffect::runThread(Thread & threadInfo, lua_State * thread, int nargs)
                 lua_pop(lua, 1);
                 break;
             }
-            threadInfo.sleepTime += int(1000.0 * lua_tonumber(thread, 2));
+        {
+            auto delay = static_cast<unsigned long>(std::max(1000.0 * lua_tonumber(thread, 2), 0.0));
+            // Waiting for no time yields until next frame rather than spinning
+            threadInfo.wakeTime = delay > 0 ? threadInfo.wakeTime + delay
+                                            : std::max(threadInfo.wakeTime, m_time + 1);
+            if (threadInfo.running) {
+                scheduleThread(threadInfo);
+            } else {
+                threadInfo.sleepTime = unsigned(threadInfo.wakeTime - std::min(threadInfo.wakeTime, m_time));
+            }
             terminate = false;
             break;
+        }
         case LUA_ERRRUN:
             luaL_traceback(lua, thread, lua_tostring(thread, -1), 0);
             m_service.log(1, lua_tostring(lua, -1));
@@ -427,18 +589,26 @@ void LuaEffect::runThread(Thread & threadInfo, lua_State * thread, int nargs)
             m_service.log(1, "unexpected error");
     }
     if (terminate) {
-        destroyThread(m_state.get(), threadInfo);
+        destroyThread(lua, threadInfo);
     }
     CHECK_TOP(lua, 0);
 }
 
 /****************************************************************************/
-// Static Helper methods
+// Helper methods
+
+/// Pushes a global variable of the script
+void LuaEffect::pushGlobal(lua_State * lua, const char * name) const
+{
+    lua_rawgeti(lua, LUA_REGISTRYINDEX, m_environment); // push(env)
+    lua_getfield(lua, -1, name);            // push(value)
+    lua_remove(lua, -2);                    // pop(env)
+}
 
-bool LuaEffect::pushHook(lua_State * lua, const char * name)
+bool LuaEffect::pushHook(lua_State * lua, const char * name) const
 {
     SAVE_TOP(lua);
-    lua_getglobal(lua, name);               // push(hook)
+    pushGlobal(lua, name);                  // push(hook)
     if (!lua_isfunction(lua, -1)) {
         lua_pop(lua, 1);                    // pop(hook)
         CHECK_TOP(lua, 0);
@@ -471,16 +641,18 @@ bool LuaEffect::handleError(lua_State * lua, EffectService & service, int code)
     return ok;
 }
 
-// Ensure unique_ptr works on lua_State
-namespace std {
-    void default_delete<lua_State>::operator()(lua_State *p) const { lua_close(p); }
-}
-
 /****************************************************************************/
 
 /// Convert a lua panic into abort - gives better messages than letting lua exit().
 static int luaPanicHandler(lua_State *) { abort(); }
 
+/// Appends compiled chunk data to a string, for lua_dump
+static int writeChunk(lua_State *, const void * data, size_t size, void * buffer)
+{
+    static_cast<std::string *>(buffer)->append(static_cast<const char *>(data), size);
+    return 0;
+}
+
 /// Builds the error message for script errors
 static int luaErrorHandler(lua_State * lua)
 {
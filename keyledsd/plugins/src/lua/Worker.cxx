@@ -0,0 +1,435 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "lua/Worker.h"
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "keyledsd/accelerated.h"
+#include "keyledsd/utils.h"
+#include "lua/Host.h"
+#include "lua/LuaEffect.h"
+
+using keyleds::plugin::lua::Worker;
+using string_map = std::vector<std::pair<std::string, std::string>>;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory exchange requires lock-free atomics");
+
+static constexpr std::size_t alignBytes = 64;       ///< Frame slot alignment, as RenderTarget
+static constexpr std::size_t maxMessageSize = 1 << 20;  ///< Largest message worker accepts
+static constexpr unsigned defaultDeadline = 100;    ///< Default frame deadline, in milliseconds
+static constexpr unsigned startupDeadline = 1000;   ///< Deadline for first frame, in milliseconds
+static constexpr unsigned freshFlag = 8;            ///< Marks a slot the reader has not seen yet
+
+/// Messages sent to the worker, identified by their first byte
+enum class Message : char { Render, KeyEvent, ContextChange, GenericEvent, Reload };
+
+/// Frame exchange, at the start of the shared memory mapping. It is followed by six
+/// frame slots: three carrying keyleds' frames to the worker, and three carrying them
+/// back. Each holds the index of the slot last published, with freshFlag if the
+/// reader has not taken it yet. Writer and reader each own another slot of the three.
+struct Worker::Shared final
+{
+    std::atomic<unsigned>   input;  ///< Keyleds to worker, slots 0 to 2
+    std::atomic<unsigned>   output; ///< Worker to keyleds, slots 3 to 5
+    bool    isLayer[6];     ///< Set before publishing a slot holding a layer to blend,
+                            ///  rather than a whole frame rendered on top of keyleds' one
+};
+
+/// Returns the given value, aligned to upper bound of given aligment
+static constexpr std::size_t align(std::size_t value, std::size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+/// Hands over the slot just written to the reader, returns the slot to write next
+static unsigned publish(std::atomic<unsigned> & middle, unsigned back)
+{
+    return middle.exchange(back | freshFlag, std::memory_order_acq_rel) & ~freshFlag;
+}
+
+/// Takes the last published slot if reader has not seen it, returns the slot to read
+static unsigned acquire(std::atomic<unsigned> & middle, unsigned front, bool * fresh)
+{
+    *fresh = (middle.load(std::memory_order_relaxed) & freshFlag) != 0;
+    if (!*fresh) { return front; }
+    return middle.exchange(front, std::memory_order_acq_rel) & ~freshFlag;
+}
+
+/// Formats a message describing current errno
+static std::string systemError(const char * what)
+{
+    return std::string(what) + ": " + std::strerror(errno);
+}
+
+/// Serializes a string map as a message, with null-terminated keys and values
+static std::string encodeMap(Message type, const string_map & values)
+{
+    std::string result(1, static_cast<char>(type));
+    for (const auto & item : values) {
+        result.append(item.first).push_back('\0');
+        result.append(item.second).push_back('\0');
+    }
+    return result;
+}
+
+/// Reverses encodeMap, given message data without its type
+static string_map decodeMap(const char * data, std::size_t size)
+{
+    string_map result;
+    const char * const end = data + size;
+    while (data < end) {
+        auto * keyEnd = std::find(data, end, '\0');
+        if (keyEnd == end) { break; }
+        auto * valueEnd = std::find(keyEnd + 1, end, '\0');
+        if (valueEnd == end) { break; }
+        result.emplace_back(std::string(data, keyEnd), std::string(keyEnd + 1, valueEnd));
+        data = valueEnd + 1;
+    }
+    return result;
+}
+
+/****************************************************************************/
+// Lifecycle management
+
+Worker::Worker(EffectService & service)
+ : m_service(service),
+   m_scratch(nullptr),
+   m_shared(nullptr),
+   m_sharedSize(0),
+   m_slotSize(0),
+   m_socket(-1),
+   m_pid(-1),
+   m_inputSlot(0),
+   m_outputSlot(5),
+   m_hasFrame(false),
+   m_isLayer(false),
+   m_pendingTime(0),
+   m_waitedTime(0),
+   m_deadline(defaultDeadline)
+{
+    keyleds::parseNumber(m_service.getConfig("frame-deadline"), &m_deadline);
+}
+
+Worker::~Worker()
+{
+    stopWorker();
+    if (m_socket >= 0) { close(m_socket); }
+    if (m_shared) {
+        m_shared->~Shared();
+        munmap(m_shared, m_sharedSize);
+    }
+    if (m_scratch) { m_service.destroyRenderTarget(m_scratch); }
+}
+
+std::unique_ptr<Worker> Worker::create(const std::string & name, EffectService & service,
+                                       const std::string & chunk)
+{
+    auto worker = std::make_unique<Worker>(service);
+    if (!worker->start(name, chunk)) { return nullptr; }
+    return worker;
+}
+
+/// Closes all descriptors but standard streams and given one. Runs in the worker right
+/// after it is forked, while keyleds' other threads may be holding locks, so it relies
+/// on nothing that takes one but the allocator, which glibc resets on fork.
+static void closeInheritedDescriptors(int keep)
+{
+#ifdef SYS_close_range
+    const unsigned first = STDERR_FILENO + 1;
+    if ((unsigned(keep) <= first || syscall(SYS_close_range, first, unsigned(keep) - 1, 0u) == 0)
+        && syscall(SYS_close_range, std::max(unsigned(keep) + 1, first), ~0u, 0u) == 0) {
+        return;
+    }
+#endif
+    // Kernel predates close_range, walk descriptor list instead
+    DIR * dir = opendir("/proc/self/fd");
+    if (!dir) { _exit(1); }
+    std::vector<int> inherited;
+    while (const auto * entry = readdir(dir)) {
+        const int fd = std::atoi(entry->d_name);
+        if (fd > STDERR_FILENO && fd != keep && fd != dirfd(dir)) { inherited.push_back(fd); }
+    }
+    closedir(dir);
+    for (int fd : inherited) { close(fd); }
+}
+
+bool Worker::start(const std::string & name, const std::string & chunk)
+{
+    m_scratch = m_service.createRenderTarget();
+    m_slotSize = m_scratch->capacity();
+
+    // Shared memory is mapped before forking, so both processes see the same pages
+    const auto slotBytes = align(m_slotSize * sizeof(RGBAColor), alignBytes);
+    m_sharedSize = align(sizeof(Shared), alignBytes) + 6 * slotBytes;
+    void * memory = mmap(nullptr, m_sharedSize, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        m_service.log(1, systemError("cannot map worker memory").c_str());
+        return false;
+    }
+    m_shared = new (memory) Shared();
+    m_shared->input.store(1, std::memory_order_relaxed);
+    m_shared->output.store(4, std::memory_order_relaxed);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0) {
+        m_service.log(1, systemError("cannot create worker socket").c_str());
+        return false;
+    }
+
+    const pid_t parent = getpid();
+    m_pid = fork();
+    if (m_pid < 0) {
+        m_service.log(1, systemError("cannot start worker").c_str());
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (m_pid == 0) {
+        // Keyleds stops the worker itself, it must not act on signals meant for keyleds
+        std::signal(SIGINT, SIG_IGN);
+        std::signal(SIGTERM, SIG_IGN);
+        std::signal(SIGHUP, SIG_IGN);
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        if (getppid() != parent) { _exit(0); }      // keyleds died before prctl
+
+        // Device, inotify and other workers' descriptors are not for the script to reach
+        closeInheritedDescriptors(fds[1]);
+        m_socket = fds[1];
+        run(name, chunk);
+    }
+    close(fds[1]);
+    m_socket = fds[0];
+    return true;
+}
+
+bool Worker::checkWorker()
+{
+    if (m_pid < 0) { return false; }
+
+    int status;
+    if (waitpid(m_pid, &status, WNOHANG) != m_pid) { return true; }
+    m_pid = -1;
+
+    const auto message = WIFSIGNALED(status)
+                       ? "worker killed by signal " + std::to_string(WTERMSIG(status))
+                       : "worker exited with status " + std::to_string(WEXITSTATUS(status));
+    m_service.log(1, message.c_str());
+    return false;
+}
+
+void Worker::stopWorker()
+{
+    if (m_pid < 0) { return; }
+    kill(m_pid, SIGKILL);
+    while (waitpid(m_pid, nullptr, 0) < 0 && errno == EINTR) {}
+    m_pid = -1;
+}
+
+bool Worker::send(const std::string & message)
+{
+    // Never wait for the worker, it is either stalled or its queue is full
+    if (::send(m_socket, message.data(), message.size(), MSG_DONTWAIT | MSG_NOSIGNAL) >= 0) {
+        return true;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        m_service.log(2, systemError("cannot send to worker").c_str());
+    }
+    return false;
+}
+
+keyleds::RGBAColor * Worker::slot(unsigned idx)
+{
+    auto * base = reinterpret_cast<char *>(m_shared) + align(sizeof(Shared), alignBytes);
+    return reinterpret_cast<RGBAColor *>(
+        base + idx * align(m_slotSize * sizeof(RGBAColor), alignBytes));
+}
+
+/****************************************************************************/
+// Keyleds side
+
+void Worker::reloadScript(const std::string & code)
+{
+    if (m_pid < 0) { return; }
+    if (!send(std::string(1, static_cast<char>(Message::Reload)) + code)) {
+        m_service.log(2, "could not send reloaded script to worker");
+    }
+}
+
+void Worker::render(unsigned long ms, RenderTarget & target)
+{
+    if (!checkWorker()) { return; }
+
+    // Hand our frame over if the script reads it, and request a new one
+    if (!m_isLayer) {
+        std::copy(target.begin(), target.end(), slot(m_inputSlot));
+        m_inputSlot = publish(m_shared->input, m_inputSlot);
+    }
+
+    m_pendingTime += ms;
+    std::string message(1 + sizeof(m_pendingTime), static_cast<char>(Message::Render));
+    std::memcpy(&message[1], &m_pendingTime, sizeof(m_pendingTime));
+    if (send(message)) { m_pendingTime = 0; }
+
+    // Use whatever frame the worker completed last
+    bool fresh;
+    m_outputSlot = acquire(m_shared->output, m_outputSlot, &fresh);
+    if (fresh) {
+        m_hasFrame = true;
+        m_isLayer = m_shared->isLayer[m_outputSlot];
+        m_waitedTime = 0;
+    } else {
+        m_waitedTime += ms;
+        if (m_waitedTime > (m_hasFrame ? m_deadline : startupDeadline)) {
+            m_service.log(1, "worker missed its frame deadline, stopping it");
+            stopWorker();
+            return;
+        }
+    }
+    if (!m_hasFrame) { return; }
+
+    // A layer is blended onto the live target, so a late worker does not hold lower effects
+    const auto * frame = slot(m_outputSlot);
+    if (m_isLayer) {
+        keyleds::blend(reinterpret_cast<uint8_t *>(target.data()),
+                       reinterpret_cast<const uint8_t *>(frame),
+                       std::min(target.capacity(), RenderTarget::size_type(m_slotSize)));
+    } else {
+        std::copy(frame, frame + target.size(), target.begin());
+    }
+}
+
+void Worker::handleContextChange(const string_map & context)
+{
+    if (m_pid < 0) { return; }
+    send(encodeMap(Message::ContextChange, context));
+}
+
+void Worker::handleGenericEvent(const string_map & data)
+{
+    if (m_pid < 0) { return; }
+    send(encodeMap(Message::GenericEvent, data));
+}
+
+void Worker::handleKeyEvent(const KeyDatabase::Key & key, bool press)
+{
+    if (m_pid < 0) { return; }
+    std::string message(1 + sizeof(key.index) + 1, static_cast<char>(Message::KeyEvent));
+    std::memcpy(&message[1], &key.index, sizeof(key.index));
+    message.back() = press ? 1 : 0;
+    send(message);
+}
+
+/****************************************************************************/
+// Worker side
+
+void Worker::run(const std::string & name, const std::string & chunk)
+{
+    std::unique_ptr<LuaEffect> effect;
+    try {
+        auto host = Host::create(m_service);
+        if (host) { effect = LuaEffect::create(name, m_service, std::move(host), chunk); }
+    } catch (std::exception & err) {
+        m_service.log(1, err.what());
+    }
+    if (!effect) { _exit(1); }
+
+    const auto & keyDB = m_service.keyDB();
+    auto & target = *m_scratch;
+    std::vector<char> buffer(maxMessageSize);
+    unsigned inputSlot = 2, outputSlot = 3;
+
+    for (;;) {
+        // Wait for a message, then process all queued ones, so we catch up if late
+        unsigned long elapsed = 0;
+        bool mustRender = false;
+        int flags = 0;
+        for (;;) {
+            auto size = recv(m_socket, buffer.data(), buffer.size(), flags);
+            if (size < 0) {
+                if (errno == EINTR) { continue; }
+                if (flags != 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) { break; }
+                _exit(1);
+            }
+            if (size == 0) { _exit(0); }        // keyleds closed its end
+            flags = MSG_DONTWAIT;
+
+            const char * data = buffer.data() + 1;
+            const auto dataSize = static_cast<std::size_t>(size) - 1;
+            switch (static_cast<Message>(buffer[0])) {
+            case Message::Render: {
+                unsigned long ms;
+                if (dataSize < sizeof(ms)) { break; }
+                std::memcpy(&ms, data, sizeof(ms));
+                elapsed += ms;
+                mustRender = true;
+                break;
+            }
+            case Message::KeyEvent: {
+                RenderTarget::size_type index;
+                if (dataSize < sizeof(index) + 1) { break; }
+                std::memcpy(&index, data, sizeof(index));
+                if (index < keyDB.size()) {
+                    effect->handleKeyEvent(keyDB[index], data[sizeof(index)] != 0);
+                }
+                break;
+            }
+            case Message::ContextChange:
+                effect->handleContextChange(decodeMap(data, dataSize));
+                break;
+            case Message::GenericEvent:
+                effect->handleGenericEvent(decodeMap(data, dataSize));
+                break;
+            case Message::Reload:
+                effect->reloadScript(std::string(data, dataSize));
+                break;
+            }
+        }
+        if (!mustRender) { continue; }
+
+        // Scripts with a layer of their own do not read the target, send the layer alone.
+        // Others render on top of the latest frame keyleds handed over.
+        const auto * layer = effect->renderLayer(elapsed);
+        if (layer) {
+            std::copy(layer->begin(), layer->end(), slot(outputSlot));
+        } else {
+            bool fresh;
+            inputSlot = acquire(m_shared->input, inputSlot, &fresh);
+            const auto * input = slot(inputSlot);
+            std::copy(input, input + target.size(), target.begin());
+
+            effect->render(elapsed, target);
+            std::copy(target.begin(), target.end(), slot(outputSlot));
+        }
+        m_shared->isLayer[outputSlot] = layer != nullptr;
+        outputSlot = publish(m_shared->output, outputSlot);
+        effect->frameDone();
+    }
+}
@@ -16,7 +16,10 @@
  */
 #include "lua/lua_Interpolator.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <functional>
 #include <lua.hpp>
 #include "lua/Environment.h"
 #include "lua/lua_common.h"
@@ -25,32 +28,69 @@ static constexpr lua_Number maximumDuration = 3600000;  // One hour
 
 namespace keyleds { namespace lua {
 
-static const void * const interpolatorToken = &interpolatorToken;
-static const char targetLink[] = "target";
-
 /****************************************************************************/
 
-static void pushRegistry(lua_State * lua)
-{
-    SAVE_TOP(lua);
-    lua_pushlightuserdata(lua, const_cast<void *>(interpolatorToken));
-    lua_rawget(lua, LUA_REGISTRYINDEX);
-    if (!lua_istable(lua, -1)) {
-        lua_pop(lua, 1);
-        lua_createtable(lua, 1, 1);
-        lua_pushlightuserdata(lua, const_cast<void *>(interpolatorToken));
-        lua_pushvalue(lua, -2);
-        lua_rawset(lua, LUA_REGISTRYINDEX);
-    }
-    CHECK_TOP(lua, +1);
+static InterpolatorStore & getStore(lua_State * lua)
+{
+    auto * controller = Environment(lua).controller();
+    if (!controller) { luaL_error(lua, noEffectTokenErrorMessage); }
+    return controller->interpolators();
+}
+
+using progress_table = std::array<std::uint16_t, Gradient::resolution + 1>;
+
+/// Returns eased progress for each linear progress step, both in [0, Gradient::resolution]
+static const progress_table & easingTable(Easing easing)
+{
+    static const std::array<progress_table, 4> tables = []() {
+        auto build = [](auto && curve) {
+            progress_table table;
+            for (unsigned idx = 0; idx <= Gradient::resolution; ++idx) {
+                double t = double(idx) / Gradient::resolution;
+                table[idx] = std::uint16_t(std::lround(curve(t) * Gradient::resolution));
+            }
+            return table;
+        };
+        return std::array<progress_table, 4>{{
+            build([](double t) { return t; }),
+            build([](double t) { return t * t * t; }),
+            build([](double t) { return 1.0 - (1.0 - t) * (1.0 - t) * (1.0 - t); }),
+            build([](double t) {
+                return t < 0.5 ? 4.0 * t * t * t : 1.0 - 4.0 * (1.0 - t) * (1.0 - t) * (1.0 - t);
+            })
+        }};
+    }();
+    return tables[static_cast<unsigned>(easing)];
 }
 
+static RGBAColor interpolate(RGBAColor start, RGBAColor finish, unsigned progress)
+{
+    using ct = RGBAColor::channel_type;
+    const unsigned remaining = Gradient::resolution - progress;
+    return {
+        ct((start.red * remaining + finish.red * progress) / Gradient::resolution),
+        ct((start.green * remaining + finish.green * progress) / Gradient::resolution),
+        ct((start.blue * remaining + finish.blue * progress) / Gradient::resolution),
+        ct((start.alpha * remaining + finish.alpha * progress) / Gradient::resolution)
+    };
+}
+
+static const char * const easingNames[] = { "linear", "ease-in", "ease-out", "ease-in-out", nullptr };
+
 /****************************************************************************/
 
+/// fade(duration, [startColor,] finishColor [, easing])
+/// fade(duration, {color, color, ...} [, easing])
 int luaNewInterpolator(lua_State * lua)
 {
     // Analyze arguments
-    if (lua_gettop(lua) > 3) { return luaL_error(lua, tooManyArgumentsErrorMessage); }
+    int nargs = lua_gettop(lua);
+    auto easing = Easing::Linear;
+    if (nargs >= 3 && lua_type(lua, nargs) == LUA_TSTRING) {
+        easing = static_cast<Easing>(luaL_checkoption(lua, nargs, nullptr, easingNames));
+        --nargs;
+    }
+    if (nargs > 3) { return luaL_error(lua, tooManyArgumentsErrorMessage); }
 
     int flags = 0;
 
@@ -60,21 +100,34 @@ int luaNewInterpolator(lua_State * lua)
     }
 
     RGBAColor startValue, finishValue;
-    if (lua_gettop(lua) == 3) {
+    std::shared_ptr<const Gradient> gradient;
+    if (nargs == 3) {
         startValue = lua_checkcolor(lua, 2);
         finishValue = lua_checkcolor(lua, 3);
         flags |= Interpolator::hasStartValueFlag;
+    } else if (lua_istable(lua, 2) && !lua_is<RGBAColor>(lua, 2)) {
+        std::vector<RGBAColor> stops(lua_objlen(lua, 2));
+        for (std::size_t idx = 0; idx < stops.size(); ++idx) {
+            lua_rawgeti(lua, 2, idx + 1);                       // push(color)
+            if (!lua_iscolor(lua, -1)) { return luaL_argerror(lua, 2, badTypeErrorMessage); }
+            stops[idx] = lua_tocolor(lua, -1);
+            lua_pop(lua, 1);                                    // pop(color)
+        }
+        if (stops.size() < 2) { return luaL_argerror(lua, 2, "gradient needs two colors or more"); }
+
+        startValue = stops.front();
+        finishValue = stops.back();
+        flags |= Interpolator::hasStartValueFlag;
+        if (stops.size() > 2) { gradient = std::make_shared<Gradient>(stops); }
     } else {
         finishValue = lua_checkcolor(lua, 2);
     }
 
     // Create object
     lua_push(lua, Interpolator{
-        LUA_NOREF, flags, 0, unsigned(duration), 0, startValue, finishValue
+        0, flags, nullptr, 0, unsigned(duration), startValue, finishValue,
+        easing, std::move(gradient)
     });                                                         // push(interpol)
-    lua_createtable(lua, 0, 1);                                 // push(fenv)
-    lua_setfenv(lua, -2);                                       // pop(fenv)
-
     return 1;
 }
 
@@ -92,6 +145,12 @@ static const struct luaL_Reg methods[] = {
     { nullptr,      nullptr }
 };
 
+static int destroy(lua_State * lua)
+{
+    lua_to<Interpolator>(lua, 1).~Interpolator();
+    return 0;
+}
+
 static int index(lua_State * lua)
 {
     if (lua_handleMethodIndex(lua, 2, methods)) { return 1; }
@@ -108,131 +167,174 @@ void Interpolator::start(lua_State * lua, unsigned keyIndex)
 
     auto & interpolator = lua_to<Interpolator>(lua, -2);
     auto * target = lua_to<RenderTarget *>(lua, -1);
+    auto & store = getStore(lua);
 
-    if (interpolator.id != LUA_NOREF) {
+    if (interpolator.serial != 0 &&
+        store.running(interpolator.target, interpolator.index, interpolator.serial)) {
         luaL_error(lua, "interpolator already active");
         // does not return
     }
 
-    SAVE_TOP(lua);
-    pushRegistry(lua);                                              // push(registry)
-
-    // see whether another interpolator already runs on this key
-    size_t size = lua_objlen(lua, -1);
-    for (size_t index = 1; index <= size; ++index) {
-        lua_rawgeti(lua, -1, index);                                // push(otherinter)
-        if (lua_is<Interpolator>(lua, -1)) {
-            auto & other = lua_to<Interpolator>(lua, -1);
-            if (other.index == keyIndex) {
-                lua_getfenv(lua, -1);                               // push(otherfenv)
-                lua_getfield(lua, -1, targetLink);                  // push(othertarget)
-                auto * otherTarget = lua_to<RenderTarget *>(lua, -1);
-                lua_pop(lua, 2);                                    // pop(otherfenv, othertarget)
-                if (otherTarget == target) {
-                    Interpolator::stop(lua);    // (pop(otherinter))
-                    continue;
-                }
-            }
-        }
-        lua_pop(lua, 1);                                            // pop(otherinter)
-    }
-
-    lua_pushvalue(lua, -3);                                         // push(interpolator)
-    interpolator.id = luaL_ref(lua, -2);                            // pop(interpolator)
-
     // fill in missing values
-    interpolator.index = keyIndex;
-    interpolator.elapsed = 0;
+    auto startValue = interpolator.startValue;
     if ((interpolator.flags & Interpolator::hasStartValueFlag) == 0) {
-        interpolator.startValue = (*lua_to<RenderTarget *>(lua, -2))[keyIndex];
+        startValue = (*target)[keyIndex];
     } else {
-        (*target)[keyIndex] = interpolator.startValue;
+        (*target)[keyIndex] = startValue;
     }
 
-    // create a reference to the render target
-    lua_getfenv(lua, -3);                                           // push(fenv)
-    lua_pushvalue(lua, -3);                                         // push(target)
-    lua_setfield(lua, -2, targetLink);                              // pop(target)
+    interpolator.serial = store.start(target, keyIndex, interpolator, startValue);
+    interpolator.target = target;
+    interpolator.index = keyIndex;
 
-    lua_pop(lua, 4);                                                // pop(arg1, arg2, registry, fenv)
-    CHECK_TOP(lua, -2);
+    lua_pop(lua, 2);                                                // pop(arg1, arg2)
 }
 
 void Interpolator::stop(lua_State * lua)
 {
-    SAVE_TOP(lua);
     assert(lua_gettop(lua) >= 1);
     assert(lua_is<Interpolator>(lua, -1));
 
     auto & interpolator = lua_to<Interpolator>(lua, -1);
+    if (interpolator.serial != 0) {
+        getStore(lua).stop(interpolator.target, interpolator.index, interpolator.serial);
+    }
+    lua_pop(lua, 1);                                                // pop(interpolator)
+}
+
+/****************************************************************************/
 
-    lua_getfenv(lua, -1);                                   // push(fenv)
-    pushRegistry(lua);                                      // push(registry)
+constexpr unsigned Gradient::resolution;
 
-    // unregister interpolator from running list
-    luaL_unref(lua, -1, interpolator.id);
-    interpolator.id = LUA_NOREF;
+Gradient::Gradient(const std::vector<RGBAColor> & stops)
+{
+    assert(stops.size() >= 2);
+    const unsigned segments = stops.size() - 1;
+    for (unsigned idx = 0; idx <= resolution; ++idx) {
+        const unsigned position = idx * segments;           // in resolution units
+        const unsigned segment = std::min(position / resolution, segments - 1);
+        m_colors[idx] = interpolate(stops[segment], stops[segment + 1],
+                                    position - segment * resolution);
+    }
+}
 
-    // remove reference to the render target
-    lua_pushnil(lua);                                       // push(nil)
-    lua_setfield(lua, -3, targetLink);                      // pop(nil)
+/****************************************************************************/
 
-    lua_pop(lua, 3);                                        // pop(interpolator, fenv, registry)
-    CHECK_TOP(lua, -1);
+InterpolatorStore::InterpolatorStore()
+ : m_nextSerial(1)
+{}
+
+InterpolatorStore::serial_type
+InterpolatorStore::start(RenderTarget * target, unsigned index, const Interpolator & interpolator,
+                         RGBAColor startValue)
+{
+    const auto serial = m_nextSerial++;
+
+    auto it = m_slots.find(slot_key(target, index));
+    if (it != m_slots.end()) {
+        // Replace animation running on the same key
+        const auto pos = it->second;
+        m_elapsed[pos] = 0;
+        m_durations[pos] = interpolator.duration;
+        m_startValues[pos] = startValue;
+        m_finishValues[pos] = interpolator.finishValue;
+        m_easings[pos] = interpolator.easing;
+        m_gradients[pos] = interpolator.gradient;
+        m_serials[pos] = serial;
+        return serial;
+    }
+
+    m_slots.emplace(slot_key(target, index), m_targets.size());
+    m_targets.push_back(target);
+    m_indices.push_back(index);
+    m_elapsed.push_back(0);
+    m_durations.push_back(interpolator.duration);
+    m_startValues.push_back(startValue);
+    m_finishValues.push_back(interpolator.finishValue);
+    m_easings.push_back(interpolator.easing);
+    m_gradients.push_back(interpolator.gradient);
+    m_serials.push_back(serial);
+    return serial;
+}
+
+bool InterpolatorStore::running(RenderTarget * target, unsigned index, serial_type serial) const
+{
+    auto it = m_slots.find(slot_key(target, index));
+    return it != m_slots.end() && m_serials[it->second] == serial;
 }
 
-void Interpolator::stepAll(lua_State * lua, unsigned ms)
+void InterpolatorStore::stop(RenderTarget * target, unsigned index, serial_type serial)
 {
-    SAVE_TOP(lua);
-    pushRegistry(lua);                                              // push(registry)
-    size_t size = lua_objlen(lua, -1);
+    auto it = m_slots.find(slot_key(target, index));
+    if (it != m_slots.end() && m_serials[it->second] == serial) { remove(it->second); }
+}
 
-    for (size_t index = 1; index <= size; ++index) {
-        lua_rawgeti(lua, -1, index);                                // push(interpolator)
-        if (lua_is<Interpolator>(lua, -1)) {
-            auto & interpolator = lua_to<Interpolator>(lua, -1);
+void InterpolatorStore::removeTarget(const RenderTarget * target)
+{
+    for (std::size_t pos = m_targets.size(); pos-- > 0; ) {
+        if (m_targets[pos] == target) { remove(pos); }
+    }
+}
 
-            lua_getfenv(lua, -1);                                   // push(fenv)
-            lua_getfield(lua, -1, targetLink);                      // push(target)
-            auto * target = lua_to<RenderTarget *>(lua, -1);
-            assert(target);
-            lua_pop(lua, 2);                                        // pop(fenv, target)
+void InterpolatorStore::step(unsigned ms)
+{
+    const auto size = m_targets.size();
 
-            interpolator.elapsed += ms;
-            if (interpolator.elapsed >= interpolator.duration) {
-                (*target)[interpolator.index] = interpolator.finishValue;
-                Interpolator::stop(lua);                            // pop(interpolator)
-                continue;
-            }
+    for (std::size_t pos = 0; pos < size; ++pos) {
+        m_elapsed[pos] = std::min(m_elapsed[pos] + ms, m_durations[pos]);
+    }
+    for (std::size_t pos = 0; pos < size; ++pos) {
+        const auto progress = easingTable(m_easings[pos])[
+            (std::uint64_t(m_elapsed[pos]) * Gradient::resolution) / m_durations[pos]
+        ];
+        (*m_targets[pos])[m_indices[pos]] = m_gradients[pos]
+            ? (*m_gradients[pos])[progress]
+            : interpolate(m_startValues[pos], m_finishValues[pos], progress);
+    }
 
-            (*target)[interpolator.index] = interpolator.value();
-        }
-        lua_pop(lua, 1);                                            // pop(interpolator)
+    // Remove finished animations, last ones first so positions remain valid
+    for (std::size_t pos = size; pos-- > 0; ) {
+        if (m_elapsed[pos] >= m_durations[pos]) { remove(pos); }
     }
+}
 
-    lua_pop(lua, 1);                                                // pop(registry)
-    CHECK_TOP(lua, 0);
+void InterpolatorStore::remove(std::size_t pos)
+{
+    const auto last = m_targets.size() - 1;
+    m_slots.erase(slot_key(m_targets[pos], m_indices[pos]));
+    if (pos != last) {
+        m_targets[pos] = m_targets[last];
+        m_indices[pos] = m_indices[last];
+        m_elapsed[pos] = m_elapsed[last];
+        m_durations[pos] = m_durations[last];
+        m_startValues[pos] = m_startValues[last];
+        m_finishValues[pos] = m_finishValues[last];
+        m_easings[pos] = m_easings[last];
+        m_gradients[pos] = std::move(m_gradients[last]);
+        m_serials[pos] = m_serials[last];
+        m_slots[slot_key(m_targets[pos], m_indices[pos])] = pos;
+    }
+    m_targets.pop_back();
+    m_indices.pop_back();
+    m_elapsed.pop_back();
+    m_durations.pop_back();
+    m_startValues.pop_back();
+    m_finishValues.pop_back();
+    m_easings.pop_back();
+    m_gradients.pop_back();
+    m_serials.pop_back();
 }
 
-RGBAColor Interpolator::value() const
+std::size_t InterpolatorStore::SlotKeyHash::operator()(const slot_key & key) const noexcept
 {
-    using ct = RGBAColor::channel_type;
-    return {
-        ct(int(startValue.red) +
-           (int(finishValue.red) - int(startValue.red)) * int(elapsed) / int(duration)),
-        ct(int(startValue.green) +
-           (int(finishValue.green) - int(startValue.green)) * int(elapsed) / int(duration)),
-        ct(int(startValue.blue) +
-           (int(finishValue.blue) - int(startValue.blue)) * int(elapsed) / int(duration)),
-        ct(int(startValue.alpha) +
-           (int(finishValue.alpha) - int(startValue.alpha)) * int(elapsed) / int(duration))
-    };
+    return std::hash<const RenderTarget *>()(key.first) ^ (std::size_t(key.second) * 0x9e3779b9);
 }
 
 /****************************************************************************/
 
 const char * metatable<Interpolator>::name = "Interpolator";
 const struct luaL_Reg metatable<Interpolator>::meta_methods[] = {
+    { "__gc",           destroy },
     { "__index",        index },
     { nullptr,          nullptr}
 };
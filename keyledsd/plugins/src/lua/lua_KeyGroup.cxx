@@ -27,17 +27,42 @@ namespace keyleds { namespace lua {
 
 /****************************************************************************/
 
+/// Builds a plain array of the group's key indices, 1-based, as accepted by render targets
+static int indices(lua_State * lua)
+{
+    const auto * group = lua_check<const KeyDatabase::KeyGroup *>(lua, 1);
+
+    lua_createtable(lua, static_cast<int>(group->size()), 0);
+    int idx = 1;
+    for (const auto & key : *group) {
+        lua_pushinteger(lua, key.index + 1);
+        lua_rawseti(lua, -2, idx++);
+    }
+    return 1;
+}
+
+static const luaL_Reg methods[] = {
+    { "indices",    indices },
+    { nullptr,      nullptr }
+};
+
+/****************************************************************************/
+
 static int index(lua_State * lua)
 {
     const auto * group = lua_to<const KeyDatabase::KeyGroup *>(lua, 1);
 
-    auto idx = luaL_checkinteger(lua, 2);
-    if (static_cast<size_t>(std::abs(idx)) > group->size()) {
-        return luaL_error(lua, badIndexErrorMessage, idx);
+    auto idx = lua_tointeger(lua, 2);
+    if (idx != 0) {
+        if (static_cast<size_t>(std::abs(idx)) > group->size()) {
+            return luaL_error(lua, badIndexErrorMessage, idx);
+        }
+        idx = idx > 0 ? idx - 1 : group->size() + idx;
+        lua_push(lua, &(*group)[idx]);
+        return 1;
     }
-    idx = idx > 0 ? idx - 1 : group->size() + idx;
-    lua_push(lua, &(*group)[idx]);
-    return 1;
+    if (lua_handleMethodIndex(lua, 2, methods)) { return 1; }
+    return lua_keyError(lua, 2);
 }
 
 static int len(lua_State * lua)
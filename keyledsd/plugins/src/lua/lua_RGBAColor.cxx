@@ -17,7 +17,10 @@
 #include "lua/lua_RGBAColor.h"
 
 #include <array>
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <iomanip>
 #include <sstream>
@@ -32,6 +35,21 @@ namespace keyleds { namespace lua {
 /****************************************************************************/
 
 static constexpr std::array<const char *, 4> keys = {{ "red", "green", "blue", "alpha" }};
+static constexpr lua_Number maxPackedValue = 4294967295.0;
+
+static bool isPacked(lua_State * lua, int index)
+{
+    if (lua_type(lua, index) != LUA_TNUMBER) { return false; }
+    auto value = lua_tonumber(lua, index);
+    return 0.0 <= value && value <= maxPackedValue && value == std::floor(value);
+}
+
+static RGBAColor unpack(lua_Number value)
+{
+    using ct = RGBAColor::channel_type;
+    auto packed = static_cast<std::uint32_t>(value);
+    return RGBAColor(ct(packed >> 24), ct(packed >> 16), ct(packed >> 8), ct(packed));
+}
 
 static int indexForKey(lua_State * lua, const char * key)
 {
@@ -190,8 +208,21 @@ void lua_push(lua_State * lua, RGBAColor value)
     CHECK_TOP(lua, +1);
 }
 
+void lua_pushpacked(lua_State * lua, RGBAColor value)
+{
+    lua_pushnumber(lua, lua_Number(std::uint32_t(value.red) << 24 | std::uint32_t(value.green) << 16 |
+                                   std::uint32_t(value.blue) << 8 | std::uint32_t(value.alpha)));
+}
+
+bool lua_iscolor(lua_State * lua, int index)
+{
+    return isPacked(lua, index) || lua_is<RGBAColor>(lua, index);
+}
+
 RGBAColor lua_tocolor(lua_State * lua, int index)
 {
+    if (lua_type(lua, index) == LUA_TNUMBER) { return unpack(lua_tonumber(lua, index)); }
+
     SAVE_TOP(lua);
     lua_rawgeti(lua, index, 1);
     lua_rawgeti(lua, index, 2);
@@ -216,13 +247,44 @@ RGBAColor lua_tocolor(lua_State * lua, int index)
 
 RGBAColor lua_checkcolor(lua_State * lua, int index)
 {
-    if (!lua_is<RGBAColor>(lua, index)) {
+    if (!lua_iscolor(lua, index)) {
         luaL_argerror(lua, index, badTypeErrorMessage);
         // does not return
     }
     return lua_tocolor(lua, index);
 }
 
+/****************************************************************************/
+
+/// packcolor(color), packcolor(red, green, blue [, alpha]) => number
+int luaPackColor(lua_State * lua)
+{
+    int nargs = lua_gettop(lua);
+    if (nargs == 1) {
+        lua_pushpacked(lua, lua_checkcolor(lua, 1));
+        return 1;
+    }
+    if (nargs < 3 || nargs > 4) { return luaL_error(lua, tooManyArgumentsErrorMessage); }
+
+    using ct = RGBAColor::channel_type;
+    auto channel = [lua](int idx) {
+        return ct(std::max(0, std::min(255, int(256.0 * luaL_checknumber(lua, idx)))));
+    };
+    lua_pushpacked(lua, RGBAColor(channel(1), channel(2), channel(3),
+                                  nargs == 4 ? channel(4) : ct(255)));
+    return 1;
+}
+
+/// unpackcolor(color) => red, green, blue, alpha
+int luaUnpackColor(lua_State * lua)
+{
+    auto color = lua_checkcolor(lua, 1);
+    lua_pushnumber(lua, lua_Number(color.red) / 255.0);
+    lua_pushnumber(lua, lua_Number(color.green) / 255.0);
+    lua_pushnumber(lua, lua_Number(color.blue) / 255.0);
+    lua_pushnumber(lua, lua_Number(color.alpha) / 255.0);
+    return 4;
+}
 
 /****************************************************************************/
 
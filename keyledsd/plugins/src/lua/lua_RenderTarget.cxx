@@ -18,9 +18,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <lua.hpp>
+#include <vector>
 #include "keyledsd/KeyDatabase.h"
 #include "lua/Environment.h"
+#include "lua/lua_KeyGroup.h"
 #include "lua/lua_common.h"
 
 using keyleds::KeyDatabase;
@@ -60,8 +63,60 @@ static int toTargetIndex(lua_State * lua, int idx) // 0-based
     return luaL_argerror(lua, idx, badTypeErrorMessage);
 }
 
+static uint8_t checkWeight(lua_State * lua, int idx) // 0.0 - 1.0 range to 0 - 255
+{
+    auto value = luaL_checknumber(lua, idx);
+    // Clamp before converting, out of range and NaN conversions are undefined
+    return uint8_t(std::isnan(value) ? 0.0 : std::min(255.0, std::max(0.0, 256.0 * value)));
+}
+
+/// Reads a key group, or an array of 1-based key indices, into a list of target
+/// indices. Entries outside the target are skipped. Groups use the list built with
+/// the environment when it fits the target, other lists are reused by next call.
+static const std::vector<unsigned> & toIndexList(lua_State * lua, int idx,
+                                                 RenderTarget::size_type size)
+{
+    static thread_local std::vector<unsigned> indices;
+    indices.clear();
+
+    if (lua_is<const KeyDatabase::KeyGroup *>(lua, idx)) {
+        const auto * group = lua_to<const KeyDatabase::KeyGroup *>(lua, idx);
+        const auto * cached = Environment(lua).controller()->keyGroupIndices(group);
+        if (cached && (cached->empty() || cached->back() < size)) { return *cached; }
+        for (const auto & key : *group) {
+            if (key.index < size) { indices.push_back(key.index); }
+        }
+    } else if (lua_istable(lua, idx)) {
+        const auto count = lua_objlen(lua, idx);
+        for (std::size_t item = 1; item <= count; ++item) {
+            lua_rawgeti(lua, idx, static_cast<int>(item));
+            auto value = lua_tointeger(lua, -1);
+            lua_pop(lua, 1);
+            if (value >= 1 && static_cast<RenderTarget::size_type>(value) <= size) {
+                indices.push_back(static_cast<unsigned>(value - 1));
+            }
+        }
+    } else {
+        luaL_argerror(lua, idx, badTypeErrorMessage);
+    }
+    return indices;
+}
+
 /****************************************************************************/
 
+static int add(lua_State * lua)
+{
+    using keyleds::add;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto * from = lua_check<RenderTarget *>(lua, 2);
+    if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
+
+    add(*to, *from);
+    return 0;
+}
+
 static int blend(lua_State * lua)
 {
     using keyleds::blend;
@@ -71,6 +126,12 @@ static int blend(lua_State * lua)
     auto * from = lua_check<RenderTarget *>(lua, 2);
     if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
 
+    if (!lua_isnoneornil(lua, 3)) {
+        const auto & indices = toIndexList(lua, 3, std::min(to->size(), from->size()));
+        keyleds::blend_indexed(*to, *from, indices.data(), indices.size());
+        return 0;
+    }
+
     blend(*to, *from);
     return 0;
 }
@@ -82,19 +143,82 @@ static int copy(lua_State * lua)
     auto * from = lua_check<RenderTarget *>(lua, 2);
     if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
 
+    if (!lua_isnoneornil(lua, 3)) {
+        auto * mask = lua_check<RenderTarget *>(lua, 3);
+        if (!mask) { return luaL_argerror(lua, 3, noLongerExistsErrorMessage); }
+        keyleds::copy_masked(*to, *from, *mask);
+        return 0;
+    }
+
     std::copy(from->begin(), from->end(), to->begin());
     return 0;
 }
 
+static int darken(lua_State * lua)
+{
+    using keyleds::darken;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto * from = lua_check<RenderTarget *>(lua, 2);
+    if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
+
+    darken(*to, *from);
+    return 0;
+}
+
+static int fade(lua_State * lua)
+{
+    using keyleds::fade;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+
+    fade(*to, checkWeight(lua, 2));
+    return 0;
+}
+
 static int fill(lua_State * lua)
 {
     auto * to = lua_check<RenderTarget *>(lua, 1);
     if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
 
+    if (lua_gettop(lua) >= 3) {
+        const auto & indices = toIndexList(lua, 2, to->size());
+        keyleds::fill_indexed(*to, indices.data(), indices.size(), lua_checkcolor(lua, 3));
+        return 0;
+    }
+
     std::fill(to->begin(), to->end(), lua_checkcolor(lua, 2));
     return 0;
 }
 
+static int lerp(lua_State * lua)
+{
+    using keyleds::lerp;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto * from = lua_check<RenderTarget *>(lua, 2);
+    if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
+
+    lerp(*to, *from, checkWeight(lua, 3));
+    return 0;
+}
+
+static int lighten(lua_State * lua)
+{
+    using keyleds::lighten;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto * from = lua_check<RenderTarget *>(lua, 2);
+    if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
+
+    lighten(*to, *from);
+    return 0;
+}
+
 static int multiply(lua_State * lua)
 {
     using keyleds::multiply;
@@ -108,6 +232,34 @@ static int multiply(lua_State * lua)
     return 0;
 }
 
+/// Reads a color as a packed number, which unlike indexing involves no allocation
+static int packed(lua_State * lua)
+{
+    auto * target = lua_check<RenderTarget *>(lua, 1);
+    if (!target) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+
+    int index = toTargetIndex(lua, 2);
+    if (index < 0 || unsigned(index) >= target->size()) {
+        lua_pushnil(lua);
+        return 1;
+    }
+    lua_pushpacked(lua, (*target)[index]);
+    return 1;
+}
+
+static int screen(lua_State * lua)
+{
+    using keyleds::screen;
+
+    auto * to = lua_check<RenderTarget *>(lua, 1);
+    if (!to) { return luaL_argerror(lua, 1, noLongerExistsErrorMessage); }
+    auto * from = lua_check<RenderTarget *>(lua, 2);
+    if (!from) { return luaL_argerror(lua, 2, noLongerExistsErrorMessage); }
+
+    screen(*to, *from);
+    return 0;
+}
+
 static int create(lua_State * lua)
 {
     auto * controller = Environment(lua).controller();
@@ -189,11 +341,18 @@ static int newIndex(lua_State * lua)
 
 const char * metatable<RenderTarget *>::name = "RenderTarget";
 const struct luaL_Reg metatable<RenderTarget *>::methods[] = {
+    { "add",        add },
     { "blend",      blend },
     { "copy",       copy },
+    { "darken",     darken },
+    { "fade",       fade },
     { "fill",       fill },
+    { "lerp",       lerp },
+    { "lighten",    lighten },
     { "multiply",   multiply },
     { "new",        create },
+    { "packed",     packed },
+    { "screen",     screen },
     { nullptr,      nullptr }
 };
 const struct luaL_Reg metatable<RenderTarget *>::meta_methods[] = {
@@ -74,6 +74,11 @@ public:
     }
 
     void render(unsigned long ms, RenderTarget & target) override
+    {
+        blend(target, *renderLayer(ms));
+    }
+
+    const RenderTarget * renderLayer(unsigned long ms) override
     {
         for (auto & star : m_stars) {
             star.age += ms;
@@ -86,7 +91,7 @@ public:
             );
         }
 
-        blend(target, *m_buffer);
+        return m_buffer;
     }
 
     void rebirth(Star & star)
@@ -71,6 +71,11 @@ public:
     }
 
     void render(unsigned long ms, RenderTarget & target) override
+    {
+        blend(target, *renderLayer(ms));
+    }
+
+    const RenderTarget * renderLayer(unsigned long ms) override
     {
         m_time += ms;
         if (m_time >= m_period) { m_time -= m_period; }
@@ -94,7 +99,7 @@ public:
                 (*m_buffer)[idx] = m_colors[tphi];
             }
         }
-        blend(target, *m_buffer);
+        return m_buffer;
     }
 
 private:
@@ -18,14 +18,17 @@
 #define KEYLEDSD_DEVICEMANAGER_H_0517383B
 
 #include <QObject>
+#include <QTimer>
 #include "keyledsd/Configuration.h"
 #include "keyledsd/Device.h"
 #include "keyledsd/EffectManager.h"
 #include "keyledsd/KeyDatabase.h"
 #include "keyledsd/RenderLoop.h"
+#include "tools/EvdevReader.h"
 #include "tools/FileWatcher.h"
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -43,6 +46,10 @@ class LayoutDescription;
  * It is given a device instance to manage and a reference to current
  * configuration at creation time, and coordinates feature detection,
  * layout management, and related objects' life cycle.
+ *
+ * Key events are read directly from the device's event nodes when permissions
+ * allow it. Otherwise, they are expected through handleKeyEvent, which must
+ * not be fed events from event nodes for which readsEventDevice returns true.
  */
 class DeviceManager final : public QObject
 {
@@ -73,6 +80,12 @@ private:
     };
     using effect_group_list = std::vector<EffectGroup>;
 
+    /// Values of lookup keys in a context, in Configuration::lookupValues order
+    using lookup_key = std::vector<std::string>;
+    struct LookupKeyHash final { std::size_t operator()(const lookup_key &) const noexcept; };
+    using effect_cache = std::unordered_map<lookup_key, std::vector<Effect *>, LookupKeyHash>;
+    static constexpr std::size_t maxCachedContexts = 64;
+
 public:
     using dev_list = std::vector<std::string>;
 public:
@@ -93,6 +106,8 @@ public:
     auto                    getRenderTarget() const { return RenderLoop::renderTargetFor(*m_device); }
 
           bool              paused() const { return m_renderLoop.paused(); }
+          bool              measureLatency() const { return m_renderLoop.measureLatency(); }
+    const LatencyStats &    latencyStats() const { return m_renderLoop.latencyStats(); }
 
 public:
     void                    setConfiguration(const Configuration *);
@@ -101,6 +116,9 @@ public:
     void                    handleGenericEvent(const string_map &);
     void                    handleKeyEvent(int, bool);
     void                    setPaused(bool);
+    void                    resetLatencyStats();
+    bool                    readsEventDevice(dev_t device) const
+                                { return m_evdevReader && m_evdevReader->reads(device); }
 
 private:
     // Static loaders, invoked once at manager creation to set it up
@@ -110,14 +128,30 @@ private:
     static KeyDatabase      setupKeyDatabase(Device &);
     static KeyDatabase      buildKeyDatabase(const Device &, const LayoutDescription &);
 
-    /// Loads the list of effects to activate for the given context
+    /// Drops effect groups whose definition changed between both configurations
+    void                    reuseEffectGroups(const Configuration & previous, const Configuration &);
+    /// Selects profiles applicable to this device from current configuration
+    void                    loadProfiles();
+    /// Loads the list of effects to activate for the given context, using cache if possible
     std::vector<Effect *>   loadEffects(const string_map & context);
+    /// Matches profiles against lookup values and loads their effects
+    std::vector<Effect *>   resolveEffects(const Configuration::lookup_values &);
 
     /// Instanciates an effect, combining its configuration with this device's info
     EffectGroup &           getEffectGroup(const Configuration::EffectGroup &);
+    /// Queues all effect groups used by this device's profiles for loading
+    void                    schedulePreload();
+    /// Loads next queued effect group, invoked from the event loop
+    void                    preloadNext();
+
+    /// Invoked from evdev reader thread for every key event
+    void                    handleInputKeyEvent(int, bool, tools::EvdevReader::clock::time_point);
+    /// Looks up a raw key code in the key database, returns nullptr if unknown
+    const KeyDatabase::Key * findKey(int keyCode) const;
 
 private:
     EffectManager &         m_effectManager;    ///< Manages the lifecycle of effects
+    FileWatcher &           m_fileWatcher;      ///< Lets effects watch their files
     const Configuration *   m_configuration;    ///< Reference to service configuration
 
     const std::string       m_sysPath;          ///< Device path on sys filesystem
@@ -129,9 +163,18 @@ private:
     FileWatcher::subscription m_fileWatcherSub; ///< Ensures we get notifications for devnode events
     const KeyDatabase       m_keyDB;            ///< Fully loaded key descriptions
 
+    std::vector<const Configuration::Profile *> m_profiles; ///< Profiles applicable to this device,
+                                                            ///  most prioritary first
+    const Configuration::Profile * m_defaultProfile; ///< Profile to use if none matches
+    const Configuration::Profile * m_overlayProfile; ///< Profile to always apply on top
     effect_group_list       m_effectGroups;     ///< Loaded effect group instances
+    effect_cache            m_effectCache;      ///< Resolved effects of recently seen contexts
+    std::vector<std::string> m_preloadQueue;    ///< Names of effect groups waiting for preloading
+    QTimer                  m_preloadTimer;     ///< Fires preloadNext from the event loop
     RenderLoop              m_renderLoop;       ///< The RenderLoop in charge of the device
     std::vector<Effect *>   m_activeEffects;    ///< Effects currently active on m_renderLoop
+    std::unique_ptr<tools::EvdevReader> m_evdevReader;  ///< Reads key events from m_eventDevices,
+                                                        ///  if any could be opened
 };
 
 /****************************************************************************/
@@ -17,6 +17,7 @@
 #ifndef KEYLEDSD_DISPLAYMANAGER_H_2ADCBC2A
 #define KEYLEDSD_DISPLAYMANAGER_H_2ADCBC2A
 
+#include <sys/types.h>
 #include <QObject>
 #include <memory>
 #include <string>
@@ -55,14 +56,14 @@ public:
 
 signals:
     void            contextChanged(const context_map &);
-    void            keyEventReceived(const std::string & devNode, int key, bool press);
+    void            keyEventReceived(dev_t devNum, int key, bool press);
 
 private:
     /// Receives notifications from m_contextWatcher. Forwards them through contextChanged signal.
     void            onContextChanged(const XContextWatcher::context_map &);
 
     /// Receives notifications from m_inputWatcher. Forwards them through keyEventReceived signal.
-    void            onKeyEventReceived(const std::string & devNode, int key, bool press);
+    void            onKeyEventReceived(dev_t devNum, int key, bool press);
 
 private:
     std::unique_ptr<Display>            m_display;          ///< Connection to X display
@@ -17,9 +17,14 @@
 #ifndef KEYLEDSD_KEYLEDSSERVICE_884F711D
 #define KEYLEDSD_KEYLEDSSERVICE_884F711D
 
+#include <sys/types.h>
 #include <QObject>
+#include <QTimer>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include "keyledsd/Device.h"
 #include "keyledsd/device/Logitech.h"
@@ -52,6 +57,7 @@ class Service final : public QObject
 
     using device_list = std::vector<std::unique_ptr<DeviceManager>>;
     using display_list = std::vector<std::unique_ptr<DisplayManager>>;
+    using event_device_map = std::unordered_map<dev_t, DeviceManager *>;
 public:
                         Service(EffectManager &,
                                 std::unique_ptr<Configuration>, QObject *parent = nullptr);
@@ -68,11 +74,13 @@ public:
     void                init();             ///< Invoked once to complete event-loop-depenent setup
 
     void                setConfiguration(std::unique_ptr<Configuration>);
+    /// Loads configuration file in the background, then applies it if it is valid
+    void                reloadConfiguration(std::string path);
     void                setAutoQuit(bool);
     void                setActive(bool val);
     void                setContext(const string_map &);
     void                handleGenericEvent(const string_map &);
-    void                handleKeyEvent(const std::string &, int, bool);
+    void                handleKeyEvent(dev_t, int, bool);
 
 signals:
     /// Fires whenever a device is added - whether it is in devices list is undefined
@@ -85,21 +93,36 @@ private:
     void                onConfigurationFileChanged(FileWatcher::event);
     void                onDeviceAdded(const ::device::Description &);
     void                onDeviceRemoved(const ::device::Description &);
+    void                onDisplayContextChanged(const string_map &);
+    void                onContextTimer();
     void                onDisplayAdded(std::unique_ptr<xlib::Display> &);
     void                onDisplayRemoved();
+    /// Invoked on main thread once configuration loader thread is done
+    Q_INVOKABLE void    onConfigurationLoaded();
+    /// Entry point of configuration loader thread
+    void                loadConfiguration(std::string path);
 private:
     EffectManager &     m_effectManager;    ///< Controls lifecycle of effects (injected)
     std::unique_ptr<Configuration> m_configuration;
     bool                m_autoQuit;         ///< Quit when last device is removed?
 
     string_map          m_context;          ///< Current context. Used when instanciating new managers
+    string_map          m_pendingContext;   ///< Display context changes waiting for m_contextTimer
+    QTimer              m_contextTimer;     ///< Coalesces bursts of display context changes
     bool                m_active;           ///< If clear, the service stops watching devices
     device_list         m_devices;          ///< Map of serial number to DeviceManager instances
+    event_device_map    m_eventDevices;     ///< Map of event device numbers to m_devices entries
     display_list        m_displays;         ///< Connections to X displays
 
     DeviceWatcher       m_deviceWatcher;    ///< Connection to libudev
     FileWatcher         m_fileWatcher;      ///< Connection to inotify
     FileWatcher::subscription m_fileWatcherSub; ///< Notifications for conf change
+
+    std::thread         m_loaderThread;     ///< Parses configuration files in the background
+    std::string         m_reloadPath;       ///< If non-empty, file to reload once loader is done
+    std::mutex          m_loaderMutex;      ///< Protects loader thread results
+    std::unique_ptr<Configuration> m_loadedConfiguration;   ///< Loader thread result, on success
+    std::string         m_loaderError;      ///< Loader thread result, on failure
 };
 
 /****************************************************************************/
@@ -21,6 +21,7 @@
 #include <QList>
 #include <QObject>
 #include <QString>
+#include <QVariantMap>
 
 namespace keyleds { class DeviceManager; }
 
@@ -60,6 +61,8 @@ class DeviceManagerAdaptor final : public QDBusAbstractAdaptor
     Q_PROPERTY(QString firmware READ firmware)
     Q_PROPERTY(DBusDeviceKeyInfoList keys READ keys)
     Q_PROPERTY(bool paused READ paused WRITE setPaused)
+    Q_PROPERTY(bool measureLatency READ measureLatency)
+    Q_PROPERTY(QVariantMap latency READ latency)
 public:
                 DeviceManagerAdaptor(DeviceManager *parent);
 
@@ -74,6 +77,11 @@ public:         // Simple pass-through methods accessing the DeviceManager
     DBusDeviceKeyInfoList keys() const;
     bool        paused() const;
     void        setPaused(bool val);
+    bool        measureLatency() const;
+    QVariantMap latency() const;        ///< Key latency statistics, in microseconds
+
+public slots:   // Simple pass-through methods accessing the DeviceManager
+    Q_NOREPLY void resetLatency();
 
 private:
     DeviceManager * parent() const;    ///< instance this adapter is attached to
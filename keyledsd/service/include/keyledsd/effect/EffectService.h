@@ -23,6 +23,7 @@
 #include <vector>
 #include "keyledsd/KeyDatabase.h"
 #include "keyledsd/Configuration.h"
+#include "tools/FileWatcher.h"
 
 namespace keyleds { class DeviceManager; }
 
@@ -33,8 +34,10 @@ namespace keyleds { namespace effect {
 class EffectService final : public interface::EffectService
 {
     using KeyGroup = KeyDatabase::KeyGroup;
+    using FileWatcher = tools::FileWatcher;
 public:
-    EffectService(const DeviceManager &, const Configuration::Effect &, std::vector<KeyGroup>);
+    EffectService(const DeviceManager &, FileWatcher &,
+                  const Configuration::Effect &, std::vector<KeyGroup>);
     ~EffectService();
 
     const std::string & deviceName() const override;
@@ -51,15 +54,25 @@ public:
     void                destroyRenderTarget(RenderTarget *) override;
 
     const std::string & getFile(const std::string &) override;
+    void                watchFile(const std::string &, std::function<void()>) override;
 
     void                log(unsigned, const char * msg) override;
 
+private:
+    void                subscribeFile(std::size_t idx, const std::string & path,
+                                      std::function<void()>);
+    void                onFileEvent(std::size_t idx, std::string path,
+                                    std::function<void()>, FileWatcher::event);
+
 private:
     const DeviceManager &                       m_manager;
-    const Configuration::Effect &               m_configuration;
+    FileWatcher &                               m_fileWatcher;
+    const Configuration::Effect                 m_configuration;    ///< Own copy, so the effect
+                                                                    ///  can outlive a configuration reload
     const std::vector<KeyGroup>                 m_keyGroups;
     std::vector<std::unique_ptr<RenderTarget>>  m_renderTargets;
     std::string                                 m_fileData;
+    std::vector<FileWatcher::subscription>      m_fileWatches;
 };
 
 /****************************************************************************/
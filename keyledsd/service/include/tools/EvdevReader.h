@@ -0,0 +1,78 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TOOLS_EVDEV_READER_H_C41D7A2E
+#define TOOLS_EVDEV_READER_H_C41D7A2E
+
+#include <sys/types.h>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tools {
+
+/****************************************************************************/
+
+/** Kernel input device reader
+ *
+ * Reads key events directly from evdev nodes, without going through X. A
+ * dedicated thread waits on all devices through epoll and reads events in
+ * batches, invoking the listener from that thread. Devices are not grabbed,
+ * so other programs still receive the events.
+ *
+ * Devices that cannot be opened, usually for lack of permissions, are skipped.
+ */
+class EvdevReader final
+{
+public:
+    using clock = std::chrono::steady_clock;
+    /// Receives key code, as sent by the kernel device, whether it was pressed,
+    /// and when the kernel received the event
+    using Listener = std::function<void(int key, bool press, clock::time_point)>;
+public:
+                        EvdevReader(const std::vector<std::string> & paths, Listener);
+                        EvdevReader(const EvdevReader &) = delete;
+                        ~EvdevReader();
+
+    /// Tells whether at least one device could be opened
+    bool                active() const noexcept { return !m_fds.empty(); }
+    /// Tells whether the device with given device number was opened
+    bool                reads(dev_t) const noexcept;
+
+private:
+    /// Opens an event device and adds it to the epoll set, returns false on failure
+    bool                openDevice(const std::string & path);
+    /// Reads all pending events from a device, returns false if it is gone
+    bool                readDevice(int fd);
+    /// Thread entry point, waits for events until stop is signaled
+    void                run();
+
+private:
+    Listener            m_listener;     ///< Invoked for every key event, from reader thread
+    int                 m_epoll;        ///< File descriptor of epoll set
+    int                 m_stopFd;       ///< Eventfd signaling reader thread to exit
+    std::vector<int>    m_fds;          ///< File descriptors of opened event devices
+    std::vector<dev_t>  m_devices;      ///< Device numbers of opened event devices
+    std::thread         m_thread;       ///< Reader thread, only started if active
+};
+
+/****************************************************************************/
+
+} // namespace tools
+
+#endif
@@ -17,6 +17,7 @@
 #ifndef TOOLS_XINPUTWATCHER_H_51CB4EAC
 #define TOOLS_XINPUTWATCHER_H_51CB4EAC
 
+#include <sys/types.h>
 #include <QObject>
 #include <string>
 #include <vector>
@@ -44,10 +45,10 @@ public:
 
 signals:
     /// Emitted whenever a key event happens on any slave keyboard
-    /// @param devNode the path to kernel device that the event originates from.
+    /// @param devNum the device number of kernel device that the event originates from.
     /// @param key the key code, as sent by the kernel device
     /// @param pressed true if this indicates a keypress, otherwise it's a key release
-    void            keyEventReceived(const std::string & devNode, int key, bool pressed);
+    void            keyEventReceived(dev_t devNum, int key, bool pressed);
 
 protected:
     /// Invoked from the main X display event loop for Xinput events
@@ -19,8 +19,10 @@
 #include <unistd.h>
 #include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iomanip>
 #include <sstream>
+#include <system_error>
 #include "keyledsd/device/Logitech.h"
 #include "keyledsd/effect/EffectService.h"
 #include "keyledsd/LayoutDescription.h"
@@ -61,6 +63,7 @@ DeviceManager::DeviceManager(EffectManager & effectManager, FileWatcher & fileWa
                              const Configuration * conf, QObject *parent)
     : QObject(parent),
       m_effectManager(effectManager),
+      m_fileWatcher(fileWatcher),
       m_configuration(nullptr),
       m_sysPath(description.sysPath()),
       m_serial(getSerial(description)),
@@ -71,9 +74,27 @@ DeviceManager::DeviceManager(EffectManager & effectManager, FileWatcher & fileWa
                                                        std::placeholders::_1, std::placeholders::_2,
                                                        std::placeholders::_3))),
       m_keyDB(setupKeyDatabase(*m_device)),
+      m_defaultProfile(nullptr),
+      m_overlayProfile(nullptr),
       m_renderLoop(*m_device, KEYLEDSD_RENDER_FPS)
 {
+    m_preloadTimer.setSingleShot(true);
+    m_preloadTimer.setInterval(0);
+    QObject::connect(&m_preloadTimer, &QTimer::timeout, this, &DeviceManager::preloadNext);
     setConfiguration(conf);
+
+    // Read key events directly from the kernel if we are allowed to
+    try {
+        using namespace std::placeholders;
+        m_evdevReader = std::make_unique<tools::EvdevReader>(
+            m_eventDevices, std::bind(&DeviceManager::handleInputKeyEvent, this, _1, _2, _3)
+        );
+        if (!m_evdevReader->active()) { m_evdevReader.reset(); }
+    } catch (std::system_error & error) {
+        ERROR("cannot read event devices: ", error.what());
+    }
+    VERBOSE("reading key events for ", m_serial, " from ", m_evdevReader ? "evdev" : "X");
+
     m_renderLoop.start();
 }
 
@@ -85,33 +106,89 @@ DeviceManager::~DeviceManager()
 void DeviceManager::setConfiguration(const Configuration * conf)
 {
     assert(conf != nullptr);
-    auto lock = m_renderLoop.lock();
+    m_renderLoop.setRenderThreads(conf->renderThreads());
+    m_renderLoop.setMeasureLatency(conf->measureLatency());
 
-    m_renderLoop.renderers().clear();
-    m_effectGroups.clear();
-    m_activeEffects.clear();
+    m_preloadQueue.clear();
+    m_effectCache.clear();
+    if (m_configuration != nullptr) {
+        reuseEffectGroups(*m_configuration, *conf);
+    }
 
     m_configuration = conf;
     m_name = getName(*conf, m_serial);
+    loadProfiles();
+    if (conf->preloadEffects()) { schedulePreload(); }
 }
 
+/** Keep effect groups whose definition did not change.
+ * Other groups are destroyed, and will be reloaded from the new configuration
+ * on first use. Kept effects retain their state, so reloading the configuration
+ * does not restart their animations.
+ */
+void DeviceManager::reuseEffectGroups(const Configuration & previous, const Configuration & conf)
+{
+    auto findGroup = [](const Configuration & conf, const std::string & name) {
+        const auto & groups = conf.effectGroups();
+        auto it = std::find_if(groups.begin(), groups.end(),
+                               [&name](const auto & group) { return group.name() == name; });
+        return it != groups.end() ? &*it : nullptr;
+    };
+    // Global key groups and device name are given to all effects
+    const bool deviceChanged = previous.keyGroups() != conf.keyGroups() ||
+                               getName(previous, m_serial) != getName(conf, m_serial);
+
+    auto changed = [&](const EffectGroup & group) {
+        if (deviceChanged) { return true; }
+        const auto * before = findGroup(previous, group.name());
+        const auto * after = findGroup(conf, group.name());
+        return before == nullptr || after == nullptr || *before != *after;
+    };
+    auto split = std::stable_partition(m_effectGroups.begin(), m_effectGroups.end(),
+                                       [&](const auto & group) { return !changed(group); });
+    if (split == m_effectGroups.end()) {
+        DEBUG("reusing all ", m_effectGroups.size(), " effect groups for device ", m_serial);
+        return;
+    }
+
+    // Effects can be destroyed once the render loop has released them
+    m_renderLoop.clearRenderers();
+    m_activeEffects.clear();
+    DEBUG("reusing ", split - m_effectGroups.begin(), " effect groups, reloading ",
+          m_effectGroups.end() - split, " for device ", m_serial);
+    m_effectGroups.erase(split, m_effectGroups.end());
+}
 
 void DeviceManager::setContext(const string_map & context)
 {
     m_activeEffects = loadEffects(context);
     DEBUG("enabling ", m_activeEffects.size(), " effects for loop ", &m_renderLoop);
 
-    // Notify newly-active effects of context change
-    auto lock = m_renderLoop.lock();
-    for (auto * effect : m_activeEffects) {
-        effect->handleContextChange(context);
-    }
-
     std::vector<Renderer *> renderers;
     renderers.reserve(m_activeEffects.size());
     std::transform(m_activeEffects.begin(), m_activeEffects.end(), std::back_inserter(renderers),
                    [](const auto & effect) { return effect->renderer(); });
-    m_renderLoop.renderers() = std::move(renderers);
+
+    // Newly-active effects are notified of context change by the render thread,
+    // right before their first frame, so we never wait for it here. Same goes for
+    // input events, which are delivered at the start of every frame.
+    const auto & effects = m_activeEffects;
+    m_renderLoop.setRenderers(
+        std::move(renderers),
+        [effects, context]() {
+            for (auto * effect : effects) { effect->handleContextChange(context); }
+        },
+        [effects](const RenderLoop::Event & event) {
+            switch (event.type) {
+            case RenderLoop::Event::Type::Key:
+                for (auto * effect : effects) { effect->handleKeyEvent(*event.key, event.press); }
+                break;
+            case RenderLoop::Event::Type::Generic:
+                for (auto * effect : effects) { effect->handleGenericEvent(event.values); }
+                break;
+            }
+        }
+    );
 }
 
 void DeviceManager::handleFileEvent(FileWatcher::event, uint32_t, std::string)
@@ -122,23 +199,39 @@ void DeviceManager::handleFileEvent(FileWatcher::event, uint32_t, std::string)
 
 void DeviceManager::handleGenericEvent(const string_map & context)
 {
-    auto lock = m_renderLoop.lock();
-    for (auto * effect : m_activeEffects) { effect->handleGenericEvent(context); }
+    m_renderLoop.postGenericEvent(context);
 }
 
 void DeviceManager::handleKeyEvent(int keyCode, bool press)
+{
+    const auto * key = findKey(keyCode);
+    if (key == nullptr) { return; }
+
+    // Pass event to active effects, on next frame
+    m_renderLoop.postKeyEvent(*key, press);
+    DEBUG("key ", key->name, " ", press ? "pressed" : "released", " on device ", m_serial);
+}
+
+void DeviceManager::handleInputKeyEvent(int keyCode, bool press,
+                                        tools::EvdevReader::clock::time_point time)
+{
+    const auto * key = findKey(keyCode);
+    if (key == nullptr) { return; }
+
+    // Pass event to active effects, on next frame
+    m_renderLoop.postInputKeyEvent(*key, press, time);
+    DEBUG("key ", key->name, " ", press ? "pressed" : "released", " on device ", m_serial);
+}
+
+const keyleds::KeyDatabase::Key * DeviceManager::findKey(int keyCode) const
 {
     // Convert raw key code into a reference to its database entry
     auto it = m_keyDB.findKeyCode(keyCode);
     if (it == m_keyDB.end()) {
         DEBUG("unknown key ", keyCode, " on device ", m_serial);
-        return;
+        return nullptr;
     }
-
-    // Pass event to active effects
-    auto lock = m_renderLoop.lock();
-    for (const auto & effect : m_activeEffects) { effect->handleKeyEvent(*it, press); }
-    DEBUG("key ", it->name, " ", press ? "pressed" : "released", " on device ", m_serial);
+    return &*it;
 }
 
 void DeviceManager::setPaused(bool val)
@@ -146,6 +239,11 @@ void DeviceManager::setPaused(bool val)
     m_renderLoop.setPaused(val);
 }
 
+void DeviceManager::resetLatencyStats()
+{
+    m_renderLoop.latencyStats().reset();
+}
+
 std::string DeviceManager::getSerial(const ::device::Description & description)
 {
     // Serial is stored on master USB device, so we walk up the hierarchy
@@ -246,37 +344,69 @@ keyleds::KeyDatabase DeviceManager::buildKeyDatabase(const Device & device, cons
     return db;
 }
 
-/// Applies the configuration to a string_map, matching profiles and resolving
-/// effect names. Returns the list of Effect entries in the configuration that
-/// should be loaded for the context. Returned list references Configuration
-/// entries directly, and are therefore invalidated by any operation that
-/// invalidates configuration's iterators.
-std::vector<keyleds::effect::interface::Effect *> DeviceManager::loadEffects(const string_map & context)
+/// Selects profiles applicable to this device, most prioritary first
+void DeviceManager::loadProfiles()
 {
-    // Match context against profile lookups
-    const Configuration::Profile * profile = nullptr;
-    const Configuration::Profile * defaultProfile = nullptr;
-    const Configuration::Profile * overlayProfile = nullptr;
+    m_profiles.clear();
+    m_defaultProfile = nullptr;
+    m_overlayProfile = nullptr;
 
     for (const auto & profileEntry : m_configuration->profiles()) {
         const auto & devices = profileEntry.devices();
         if (!devices.empty() && std::find(devices.begin(), devices.end(), m_name) == devices.end())
             continue;
         if (profileEntry.name() == defaultProfileName) {
-            defaultProfile = &profileEntry;
+            m_defaultProfile = &profileEntry;
         } else if (profileEntry.name() == overlayProfileName) {
-            overlayProfile = &profileEntry;
-        } else if (profileEntry.lookup().match(context)) {
-            DEBUG("profile matches: ", profileEntry.name());
-            profile = &profileEntry;
+            m_overlayProfile = &profileEntry;
+        } else {
+            m_profiles.push_back(&profileEntry);
         }
     }
+    // Last matching profile in configuration wins, so it must be tried first
+    std::reverse(m_profiles.begin(), m_profiles.end());
+}
+
+/// Applies the configuration to a string_map, matching profiles and resolving
+/// effect names. Returns the list of Effect entries in the configuration that
+/// should be loaded for the context. Returned list references Configuration
+/// entries directly, and are therefore invalidated by any operation that
+/// invalidates configuration's iterators.
+std::vector<keyleds::effect::interface::Effect *> DeviceManager::loadEffects(const string_map & context)
+{
+    // Only values used by lookups matter, contexts that agree on them resolve the same
+    const auto values = m_configuration->lookupValues(context);
+    lookup_key key;
+    key.reserve(values.size());
+    std::transform(values.begin(), values.end(), std::back_inserter(key),
+                   [](const auto * value) { return value != nullptr ? *value : std::string(); });
+
+    auto cached = m_effectCache.find(key);
+    if (cached != m_effectCache.end()) {
+        DEBUG("using cached effects for context");
+        return cached->second;
+    }
+
+    auto effects = resolveEffects(values);
+    if (m_effectCache.size() >= maxCachedContexts) { m_effectCache.clear(); }
+    m_effectCache.emplace(std::move(key), effects);
+    return effects;
+}
+
+std::vector<keyleds::effect::interface::Effect *>
+DeviceManager::resolveEffects(const Configuration::lookup_values & values)
+{
+    // Match context against profile lookups, stopping at first match
+    auto it = std::find_if(m_profiles.begin(), m_profiles.end(),
+                           [&values](const auto * profile) { return profile->lookup().match(values); });
+
+    const Configuration::Profile * profile = it != m_profiles.end() ? *it : nullptr;
     if (!profile) {
-        if (!defaultProfile) {
+        if (!m_defaultProfile) {
             ERROR("no profile matches and no default profile defined");
             return {};
         }
-        profile = defaultProfile;
+        profile = m_defaultProfile;
     }
     VERBOSE("selected profile <", profile->name(), ">");
 
@@ -293,8 +423,8 @@ std::vector<keyleds::effect::interface::Effect *> DeviceManager::loadEffects(con
         }
         effectGroups.push_back(&*eit);
     }
-    if (overlayProfile != nullptr) {
-        for (const auto & name : overlayProfile->effectGroups()) {
+    if (m_overlayProfile != nullptr) {
+        for (const auto & name : m_overlayProfile->effectGroups()) {
             auto eit = std::find_if(m_configuration->effectGroups().begin(),
                                     m_configuration->effectGroups().end(),
                                     [&name](auto & group) { return group.name() == name; });
@@ -316,6 +446,52 @@ std::vector<keyleds::effect::interface::Effect *> DeviceManager::loadEffects(con
     return effectPtrs;
 }
 
+/** Queue effect groups for preloading.
+ * Groups are loaded one per event loop iteration, so events are still processed
+ * in between. A profile switch to an already loaded group only swaps renderers.
+ */
+void DeviceManager::schedulePreload()
+{
+    auto queue = [this](const Configuration::Profile * profile) {
+        if (profile == nullptr) { return; }
+        for (const auto & name : profile->effectGroups()) {
+            if (std::find(m_preloadQueue.begin(), m_preloadQueue.end(), name) == m_preloadQueue.end()) {
+                m_preloadQueue.push_back(name);
+            }
+        }
+    };
+    queue(m_overlayProfile);
+    queue(m_defaultProfile);
+    std::for_each(m_profiles.begin(), m_profiles.end(), queue);
+    std::reverse(m_preloadQueue.begin(), m_preloadQueue.end());     // we pop from the back
+
+    DEBUG("preloading ", m_preloadQueue.size(), " effect groups for device ", m_serial);
+    if (!m_preloadQueue.empty()) { m_preloadTimer.start(); }
+}
+
+void DeviceManager::preloadNext()
+{
+    if (m_preloadQueue.empty()) { return; }
+    const auto name = std::move(m_preloadQueue.back());
+    m_preloadQueue.pop_back();
+
+    const auto & groups = m_configuration->effectGroups();
+    auto it = std::find_if(groups.begin(), groups.end(),
+                           [&name](const auto & group) { return group.name() == name; });
+    if (it != groups.end()) { getEffectGroup(*it); }   // unknown groups are reported on use
+
+    if (!m_preloadQueue.empty()) { m_preloadTimer.start(); }
+}
+
+std::size_t DeviceManager::LookupKeyHash::operator()(const lookup_key & key) const noexcept
+{
+    std::size_t result = key.size();
+    for (const auto & value : key) {
+        result ^= std::hash<std::string>()(value) + 0x9e3779b9 + (result << 6) + (result >> 2);
+    }
+    return result;
+}
+
 DeviceManager::EffectGroup & DeviceManager::getEffectGroup(const Configuration::EffectGroup & conf)
 {
     auto eit = std::lower_bound(
@@ -339,7 +515,8 @@ DeviceManager::EffectGroup & DeviceManager::getEffectGroup(const Configuration::
     std::vector<EffectManager::effect_ptr> effects;
     for (const auto & effectConf : conf.effects()) {
         auto effect = m_effectManager.createEffect(
-            effectConf.name(), std::make_unique<effect::EffectService>(*this, effectConf, keyGroups)
+            effectConf.name(),
+            std::make_unique<effect::EffectService>(*this, m_fileWatcher, effectConf, keyGroups)
         );
         if (!effect) {
             ERROR("plugin for effect ", effectConf.name(), " not found");
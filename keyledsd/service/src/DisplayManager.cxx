@@ -53,7 +53,7 @@ void DisplayManager::onContextChanged(const XContextWatcher::context_map & conte
     emit contextChanged(m_context);
 }
 
-void DisplayManager::onKeyEventReceived(const std::string & devNode, int key, bool press)
+void DisplayManager::onKeyEventReceived(dev_t devNum, int key, bool press)
 {
-    emit keyEventReceived(devNode, key, press);
+    emit keyEventReceived(devNum, key, press);
 }
@@ -16,6 +16,7 @@
  */
 #include "keyledsd/Service.h"
 
+#include <sys/stat.h>
 #include <QCoreApplication>
 #include <cassert>
 #include <functional>
@@ -84,6 +85,8 @@ Service::Service(EffectManager & effectManager,
       m_active(false),
       m_deviceWatcher(nullptr)
 {
+    m_contextTimer.setSingleShot(true);
+    QObject::connect(&m_contextTimer, &QTimer::timeout, this, &Service::onContextTimer);
     QObject::connect(&m_deviceWatcher, &DeviceWatcher::deviceAdded,
                      this, &Service::onDeviceAdded);
     QObject::connect(&m_deviceWatcher, &DeviceWatcher::deviceRemoved,
@@ -94,7 +97,9 @@ Service::Service(EffectManager & effectManager,
 
 Service::~Service()
 {
+    if (m_loaderThread.joinable()) { m_loaderThread.join(); }
     setActive(false);
+    m_eventDevices.clear();
     m_devices.clear();
 }
 
@@ -104,9 +109,8 @@ void Service::init()
         auto display = std::make_unique<xlib::Display>();
         onDisplayAdded(display);
     } catch (xlib::Error & err) {
-        CRITICAL("X display initialization failed: ", err.what());
-        QCoreApplication::quit();
-        return;
+        // Devices still get key events through evdev, if permissions allow
+        ERROR("X display initialization failed: ", err.what(), ", running without display");
     }
     setActive(true);
 }
@@ -120,6 +124,7 @@ void Service::setConfiguration(std::unique_ptr<Configuration> config)
 
     // old configuration must not be destroyed until propagation is complete
     swap(m_configuration, config);
+    m_contextTimer.setInterval(static_cast<int>(m_configuration->contextDebounce()));
 
     // Propagate configuration
     for (auto & device : m_devices) { device->setConfiguration(m_configuration.get()); }
@@ -134,6 +139,63 @@ void Service::setConfiguration(std::unique_ptr<Configuration> config)
     }
 }
 
+/** Reload configuration without blocking the event loop.
+ * The file is parsed and validated on a separate thread. Successfully loaded
+ * configuration is handed back to the main thread, while the current one stays
+ * active if loading fails. Reloads requested during loading are coalesced
+ * into a single reload once it completes.
+ */
+void Service::reloadConfiguration(std::string path)
+{
+    INFO("reloading ", path);
+    if (m_loaderThread.joinable()) {
+        m_reloadPath = std::move(path);
+        return;
+    }
+    m_loaderThread = std::thread(&Service::loadConfiguration, this, std::move(path));
+}
+
+void Service::loadConfiguration(std::string path)
+{
+    std::unique_ptr<Configuration> conf;
+    std::string error;
+    try {
+        conf = Configuration::loadFile(path);
+    } catch (std::exception & exc) {
+        error = exc.what();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_loaderMutex);
+        m_loadedConfiguration = std::move(conf);
+        m_loaderError = std::move(error);
+    }
+    QMetaObject::invokeMethod(this, "onConfigurationLoaded", Qt::QueuedConnection);
+}
+
+void Service::onConfigurationLoaded()
+{
+    m_loaderThread.join();
+
+    std::unique_ptr<Configuration> conf;
+    std::string error;
+    {
+        std::lock_guard<std::mutex> lock(m_loaderMutex);
+        conf = std::move(m_loadedConfiguration);
+        error = std::move(m_loaderError);
+    }
+    if (conf != nullptr) {
+        setConfiguration(std::move(conf));
+    } else {
+        CRITICAL("reloading failed: ", error);
+    }
+
+    if (!m_reloadPath.empty()) {
+        auto path = std::move(m_reloadPath);
+        m_reloadPath.clear();
+        reloadConfiguration(std::move(path));
+    }
+}
+
 void Service::setAutoQuit(bool val)
 {
     m_autoQuit = val;
@@ -153,39 +215,56 @@ void Service::setContext(const string_map & context)
     for (auto & device : m_devices) { device->setContext(m_context); }
 }
 
+/** Display context changes are applied after a short delay, so that changes
+ * received in the meantime are applied with them. Windows that update their
+ * title continuously thus cause at most one update per delay.
+ */
+void Service::onDisplayContextChanged(const string_map & context)
+{
+    if (m_contextTimer.interval() == 0) {
+        setContext(context);
+        return;
+    }
+    // Later values replace earlier ones, empty values must be kept to erase keys
+    for (const auto & entry : context) {
+        auto it = std::find_if(
+            m_pendingContext.begin(), m_pendingContext.end(),
+            [&entry](const auto & item) { return item.first == entry.first; }
+        );
+        if (it != m_pendingContext.end()) {
+            it->second = entry.second;
+        } else {
+            m_pendingContext.push_back(entry);
+        }
+    }
+    if (!m_contextTimer.isActive()) { m_contextTimer.start(); }
+}
+
+void Service::onContextTimer()
+{
+    string_map context;
+    context.swap(m_pendingContext);
+    setContext(context);
+}
+
 void Service::handleGenericEvent(const string_map & context)
 {
     for (auto & device : m_devices) { device->handleGenericEvent(context); }
 }
 
-void Service::handleKeyEvent(const std::string & devNode, int key, bool press)
+void Service::handleKeyEvent(dev_t devNum, int key, bool press)
 {
-    for (auto & device : m_devices) {
-        const auto & evDevs = device->eventDevices();
-        if (std::find(evDevs.begin(), evDevs.end(), devNode) != evDevs.end()) {
-            device->handleKeyEvent(key, press);
-            break;
-        }
-    }
+    auto it = m_eventDevices.find(devNum);
+    if (it == m_eventDevices.end()) { return; }
+
+    // Devices reading that event node already got the event from the kernel
+    if (!it->second->readsEventDevice(devNum)) { it->second->handleKeyEvent(key, press); }
 }
 
 /****************************************************************************/
 
 void Service::onConfigurationFileChanged(FileWatcher::event event)
 {
-    INFO("reloading ", m_configuration->path());
-
-    std::unique_ptr<Configuration> conf;
-    try {
-        conf = Configuration::loadFile(m_configuration->path());
-    } catch (std::exception & error) {
-        CRITICAL("reloading failed: ", error.what());
-    }
-    if (conf != nullptr) {
-        setConfiguration(std::move(conf));
-        return; // setConfiguration reloads the watch unconditionally
-    }
-
     if ((event & FileWatcher::event::Ignored) != 0) {
         // Happens when editors swap in the configuration file instead of rewriting it
         m_fileWatcherSub = m_fileWatcher.subscribe(
@@ -193,6 +272,7 @@ void Service::onConfigurationFileChanged(FileWatcher::event event)
             std::bind(&Service::onConfigurationFileChanged, this, std::placeholders::_1)
         );
     }
+    reloadConfiguration(m_configuration->path());
 }
 
 void Service::onDeviceAdded(const ::device::Description & description)
@@ -215,6 +295,12 @@ void Service::onDeviceAdded(const ::device::Description & description)
              ", <", manager->device().name(), ">");
 
         manager->setPaused(false);
+        for (const auto & path : manager->eventDevices()) {
+            struct stat info;
+            if (stat(path.c_str(), &info) == 0 && S_ISCHR(info.st_mode)) {
+                m_eventDevices[info.st_rdev] = manager.get();
+            }
+        }
         m_devices.emplace_back(std::move(manager));
 
     } catch (Device::error & error) {
@@ -237,6 +323,14 @@ void Service::onDeviceRemoved(const ::device::Description & description)
         std::iter_swap(it, m_devices.end() - 1);
         m_devices.pop_back();
 
+        for (auto evIt = m_eventDevices.begin(); evIt != m_eventDevices.end(); ) {
+            if (evIt->second == manager.get()) {
+                evIt = m_eventDevices.erase(evIt);
+            } else {
+                ++evIt;
+            }
+        }
+
         INFO("removing device ", manager->serial());
 
         emit deviceManagerRemoved(*manager);
@@ -254,7 +348,7 @@ void Service::onDisplayAdded(std::unique_ptr<xlib::Display> & display)
     INFO("connected to display ", display->name());
     auto displayManager = std::make_unique<DisplayManager>(std::move(display));
     QObject::connect(displayManager.get(), &DisplayManager::contextChanged,
-                     this, &Service::setContext);
+                     this, &Service::onDisplayContextChanged);
     QObject::connect(displayManager.get(), &DisplayManager::keyEventReceived,
                      this, &Service::handleKeyEvent);
     displayManager->scanDevices();
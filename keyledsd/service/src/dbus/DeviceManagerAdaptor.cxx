@@ -138,3 +138,39 @@ void DeviceManagerAdaptor::setPaused(bool val)
 {
     parent()->setPaused(val);
 }
+
+bool DeviceManagerAdaptor::measureLatency() const
+{
+    return parent()->measureLatency();
+}
+
+QVariantMap DeviceManagerAdaptor::latency() const
+{
+    using LatencyStats = keyleds::LatencyStats;
+    const auto summary = parent()->latencyStats().summary();
+
+    // Last bucket has no upper limit, so it is left out of limits
+    QVariantList limits, buckets;
+    for (unsigned idx = 0; idx < LatencyStats::bucketCount; ++idx) {
+        if (idx + 1 < LatencyStats::bucketCount) {
+            limits.append(qulonglong(LatencyStats::bucketLimit(idx).count()));
+        }
+        buckets.append(qulonglong(summary.buckets[idx]));
+    }
+
+    QVariantMap result;
+    result["count"] = qulonglong(summary.count);
+    result["expired"] = qulonglong(summary.expired);
+    result["mean"] = qulonglong(summary.mean().count());
+    result["p50"] = qulonglong(summary.percentile(50).count());
+    result["p99"] = qulonglong(summary.percentile(99).count());
+    result["max"] = qulonglong(summary.max.count());
+    result["bucketLimits"] = limits;
+    result["buckets"] = buckets;
+    return result;
+}
+
+void DeviceManagerAdaptor::resetLatency()
+{
+    parent()->resetLatencyStats();
+}
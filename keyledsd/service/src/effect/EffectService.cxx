@@ -19,6 +19,8 @@
 #include <algorithm>
 #include <cassert>
 #include <fstream>
+#include <functional>
+#include <system_error>
 #include "keyledsd/DeviceManager.h"
 #include "keyledsd/colors.h"
 #include "tools/Paths.h"
@@ -32,9 +34,11 @@ using keyleds::effect::EffectService;
 /****************************************************************************/
 
 EffectService::EffectService(const DeviceManager & manager,
+                             FileWatcher & fileWatcher,
                              const Configuration::Effect & configuration,
                              std::vector<KeyGroup> keyGroups)
  : m_manager(manager),
+   m_fileWatcher(fileWatcher),
    m_configuration(configuration),
    m_keyGroups(std::move(keyGroups))
 {}
@@ -102,6 +106,44 @@ const std::string & EffectService::getFile(const std::string & name)
     return m_fileData;
 }
 
+void EffectService::watchFile(const std::string & name, std::function<void()> listener)
+{
+    std::ifstream file;
+    std::string actualPath;
+    tools::paths::open(file, tools::paths::XDG::Data, KEYLEDSD_DATA_PREFIX "/" + name,
+                       std::ios::binary, &actualPath);
+    if (!file) { return; }
+
+    m_fileWatches.emplace_back();
+    subscribeFile(m_fileWatches.size() - 1, actualPath, std::move(listener));
+}
+
+void EffectService::subscribeFile(std::size_t idx, const std::string & path,
+                                  std::function<void()> listener)
+{
+    using std::placeholders::_1;
+    try {
+        m_fileWatches[idx] = m_fileWatcher.subscribe(
+            path, FileWatcher::event::CloseWrite,
+            std::bind(&EffectService::onFileEvent, this, idx, path, std::move(listener), _1)
+        );
+    } catch (std::system_error & error) {
+        ERROR("cannot watch ", path, ": ", error.what());
+    }
+}
+
+/// Arguments are taken by value, as resubscribing destroys the bound callback
+void EffectService::onFileEvent(std::size_t idx, std::string path,
+                                std::function<void()> listener, FileWatcher::event event)
+{
+    if ((event & FileWatcher::event::Ignored) != 0) {
+        // Happens when editors swap in the file instead of rewriting it
+        subscribeFile(idx, path, listener);
+    }
+    DEBUG("file ", path, " changed");
+    listener();
+}
+
 void EffectService::log(unsigned level, const char * msg)
 {
     l_logger.print(level, m_configuration.name() + ": " + msg);
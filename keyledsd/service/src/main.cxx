@@ -29,6 +29,7 @@
 #include <csignal>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include "config.h"
 #ifndef NO_DBUS
 #include "keyledsd/dbus/ServiceAdaptor.h"
@@ -148,13 +149,7 @@ static void handleSignalEvent(const Options & options, keyleds::Service * servic
                 QCoreApplication::quit();
                 break;
             case SIGHUP:
-                INFO("reloading ", options.configPath);
-                try {
-                    auto conf = Configuration::loadFile(options.configPath);
-                    service->setConfiguration(std::move(conf));
-                } catch (std::exception & error) {
-                    CRITICAL("reloading failed: ", error.what());
-                }
+                service->reloadConfiguration(options.configPath);
                 break;
         }
     }
@@ -164,6 +159,9 @@ static void handleSignalEvent(const Options & options, keyleds::Service * servic
 
 int main(int argc, char * argv[])
 {
+    // Must be first, so it is destroyed last and writes what others log on destruction
+    std::unique_ptr<logging::AsyncFilePolicy> logPolicy;
+
     // Must be before app, so its destructor runs after, since Service holds a ref
     keyleds::EffectManager effectManager;
 
@@ -176,9 +174,8 @@ int main(int argc, char * argv[])
 
     // Parse command line
     auto options = Options::parse(argc, argv);
-    logging::Configuration::instance().setPolicy(
-        new logging::FilePolicy(STDERR_FILENO, options.logLevel)
-    );
+    logPolicy = std::make_unique<logging::AsyncFilePolicy>(STDERR_FILENO, options.logLevel);
+    logging::Configuration::instance().setPolicy(logPolicy.get());
 
     INFO("keyledsd v" KEYLEDSD_VERSION_STR " starting up");
 
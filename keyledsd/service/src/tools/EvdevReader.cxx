@@ -0,0 +1,181 @@
+/* Keyleds -- Gaming keyboard tool
+ * Copyright (C) 2017 Julien Hartmann, juli1.hartmann@gmail.com
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "tools/EvdevReader.h"
+
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <system_error>
+#include "logging.h"
+
+// Kernel headers before 4.16 only have the timeval member
+#ifndef input_event_sec
+#define input_event_sec time.tv_sec
+#define input_event_usec time.tv_usec
+#endif
+
+LOGGING("evdev-reader");
+
+using tools::EvdevReader;
+
+static constexpr int maxEpollEvents = 8;        ///< Devices handled per epoll_wait
+static constexpr int maxInputEvents = 64;       ///< Input events read per read call
+
+/****************************************************************************/
+
+EvdevReader::EvdevReader(const std::vector<std::string> & paths, Listener listener)
+ : m_listener(std::move(listener)),
+   m_epoll(-1),
+   m_stopFd(-1)
+{
+    if ((m_epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        throw std::system_error(errno, std::generic_category());
+    }
+    if ((m_stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0) {
+        auto error = errno;
+        close(m_epoll);
+        throw std::system_error(error, std::generic_category());
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = m_stopFd;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_stopFd, &event);
+
+    for (const auto & path : paths) { openDevice(path); }
+    if (active()) { m_thread = std::thread(&EvdevReader::run, this); }
+}
+
+EvdevReader::~EvdevReader()
+{
+    if (m_thread.joinable()) {
+        uint64_t value = 1;
+        if (write(m_stopFd, &value, sizeof(value)) < 0) {
+            ERROR("could not signal reader thread: ", std::strerror(errno));
+        }
+        m_thread.join();
+    }
+    for (int fd : m_fds) { close(fd); }
+    close(m_stopFd);
+    close(m_epoll);
+}
+
+bool EvdevReader::reads(dev_t device) const noexcept
+{
+    return std::find(m_devices.begin(), m_devices.end(), device) != m_devices.end();
+}
+
+bool EvdevReader::openDevice(const std::string & path)
+{
+    // Input devices also include legacy mouse and joystick interfaces, skip them
+    auto slash = path.rfind('/');
+    if (path.compare(slash == std::string::npos ? 0 : slash + 1, 5, "event") != 0) {
+        return false;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        VERBOSE("not reading ", path, ": ", std::strerror(errno));
+        return false;
+    }
+
+    // Have the kernel timestamp events with the same clock as std::chrono::steady_clock
+    int clockId = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clockId) < 0) {
+        VERBOSE("not reading ", path, ": cannot set clock: ", std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) < 0) {
+        VERBOSE("not reading ", path, ": ", std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &event) < 0) {
+        ERROR("epoll_ctl on ", path, ": ", std::strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    m_fds.push_back(fd);
+    m_devices.push_back(info.st_rdev);
+    VERBOSE("reading key events from ", path);
+    return true;
+}
+
+bool EvdevReader::readDevice(int fd)
+{
+    struct input_event events[maxInputEvents];
+
+    for (;;) {
+        ssize_t nread = read(fd, events, sizeof(events));
+        if (nread < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN) { return true; }
+            DEBUG("read on fd ", fd, " returned error ", errno);
+            return false;
+        }
+
+        const auto count = static_cast<std::size_t>(nread) / sizeof(events[0]);
+        for (std::size_t idx = 0; idx < count; ++idx) {
+            const auto & event = events[idx];
+            if (event.type != EV_KEY || event.value == 2) { continue; }    // 2 is autorepeat
+            auto time = clock::time_point(std::chrono::duration_cast<clock::duration>(
+                std::chrono::seconds(event.input_event_sec) +
+                std::chrono::microseconds(event.input_event_usec)
+            ));
+            m_listener(event.code, event.value != 0, time);
+        }
+        if (count < maxInputEvents) { return true; }
+    }
+}
+
+void EvdevReader::run()
+{
+    struct epoll_event events[maxEpollEvents];
+
+    for (;;) {
+        int count = epoll_wait(m_epoll, events, maxEpollEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) { continue; }
+            ERROR("epoll_wait returned error ", errno);
+            return;
+        }
+        for (int idx = 0; idx < count; ++idx) {
+            const int fd = events[idx].data.fd;
+            if (fd == m_stopFd) { return; }
+            if ((events[idx].events & (EPOLLERR | EPOLLHUP)) != 0 || !readDevice(fd)) {
+                // Device is gone, it is closed on destruction
+                epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
+            }
+        }
+    }
+}
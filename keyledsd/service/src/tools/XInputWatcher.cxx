@@ -100,7 +100,7 @@ void XInputWatcher::handleEvent(const XEvent & event)
             [](const auto & device, auto id) { return device.handle() < id; }
         );
         if (it != m_devices.end() && it->handle() == data->deviceid) {
-            emit keyEventReceived(it->devNode(), data->detail - MIN_KEYCODE,
+            emit keyEventReceived(it->devNum(), data->detail - MIN_KEYCODE,
                                   event.xcookie.evtype == XI_RawKeyPress);
         }
         } break;
@@ -117,7 +117,7 @@ void XInputWatcher::onInputEnabled(int deviceId, int type)
     if (it != m_devices.end() && it->handle() == deviceId) { return; }
 
     auto device = Device(m_display, deviceId);
-    if (device.devNode().empty()) { return; }
+    if (device.devNode().empty() || device.devNum() == 0) { return; }
 
     ErrorCatcher errors;
     device.setEventMask({ XI_RawKeyPress, XI_RawKeyRelease });